@@ -0,0 +1,100 @@
+#include "annotate.hpp"
+#include "fen.hpp"
+#include "movegen.hpp"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+namespace Annotate {
+  static double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return secs.count();
+  }
+
+  Stats positions(const std::vector<Board::Position>& in, std::vector<Annotation>& out,
+                  const Options& options) {
+    auto start = std::chrono::steady_clock::now();
+    out.resize(in.size());
+    unsigned nb_threads = std::max(options.threads, 1u);
+    std::vector<uint64_t> nodes(nb_threads);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nb_threads; ++t) {
+      size_t begin = in.size() * t / nb_threads, end = in.size() * (t + 1) / nb_threads;
+      threads.emplace_back([&, t, begin, end]() {
+        Search::clear();
+        for (size_t i = begin; i < end; ++i) {
+          Board::set_position(in[i]);
+          if (!options.reuse_tt) Search::clear();
+          out[i].position = in[i];
+          out[i].result = Search::search(options.limits);
+          nodes[t] += out[i].result.nodes;
+        }
+      });
+    }
+    for (std::thread& t : threads) t.join();
+
+    Stats stats;
+    stats.positions = in.size();
+    for (uint64_t n : nodes) stats.nodes += n;
+    stats.seconds = seconds_since(start);
+    return stats;
+  }
+
+  Stats game(const Board::Position& start, const std::vector<Board::Move>& moves,
+             std::vector<Annotation>& out, const Options& options) {
+    auto t0 = std::chrono::steady_clock::now();
+    Stats stats;
+    Board::set_position(start);
+    Search::clear();
+
+    // states[0] stands for the starting position, as in self-play.
+    std::vector<Board::StateInfo> states(moves.size() + 1);
+    states[0].key = Board::key;
+    states[0].in_check = Movegen::in_check();
+    Board::st = &states[0];
+
+    for (size_t ply = 0; ; ++ply) {
+      Annotation annotation;
+      Board::get_position(annotation.position);
+      if (!options.reuse_tt) Search::clear();
+      annotation.result = Search::search(options.limits);
+      stats.nodes += annotation.result.nodes;
+      stats.positions++;
+      out.push_back(annotation);
+
+      if (ply == moves.size()) break;
+      std::vector<Board::Move> legal = Movegen::legal();
+      if (std::find(legal.begin(), legal.end(), moves[ply]) == legal.end()) break;
+      Board::do_move(moves[ply], states[ply + 1]);
+      Board::st->in_check = Movegen::in_check();
+    }
+
+    Board::st = NULL;
+    stats.seconds = seconds_since(t0);
+    return stats;
+  }
+
+  bool parse_move(std::string_view text, Board::Move& move) {
+    for (Board::Move m : Movegen::legal()) {
+      std::ostringstream os;
+      os << m;
+      if (os.str() == text) {
+        move = m;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void write(std::ostream& os, const Annotation& annotation) {
+    char fen[Fen::BUFFER_SIZE];
+    os.write(fen, Fen::write(annotation.position, fen));
+    os << " | depth " << annotation.result.depth << " |";
+    for (const Search::Line& line : annotation.result.lines) {
+      os << ' ' << line.move << ' ' << line.score;
+    }
+    os << '\n';
+  }
+}
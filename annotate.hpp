@@ -0,0 +1,54 @@
+#pragma once
+
+#include "board.hpp"
+#include "search.hpp"
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+/*
+Bulk annotation: the best few moves and their scores for many positions,
+by multi-PV search (see Search::Limits::multi_pv).
+
+Consecutive positions are usually from the same game, so they are searched
+one after another on the same thread without clearing the transposition
+table in between: most of each search after the first is then table hits
+from the one before. Batches of unrelated positions can turn that off.
+*/
+
+namespace Annotate {
+  struct Annotation {
+    Board::Position position;
+    Search::Result result; // result.lines are the annotation
+  };
+
+  struct Options {
+    Search::Limits limits; // multi_pv is the number of moves per position
+    unsigned threads = 1;
+    bool reuse_tt = true;  // keep the table from one position to the next
+  };
+
+  struct Stats {
+    uint64_t positions = 0;
+    uint64_t nodes = 0;
+    double seconds = 0;
+  };
+
+  /// Annotate positions, in order, into out. They are split into
+  /// contiguous runs, one per thread, so neighbours share a table.
+  Stats positions(const std::vector<Board::Position>& in, std::vector<Annotation>& out,
+                  const Options& options);
+
+  /// Annotate a game: start, then the position after each of moves, made
+  /// with do_move so that repetitions count. Stops at the first illegal
+  /// move, so out has moves.size() + 1 annotations only if all were legal.
+  Stats game(const Board::Position& start, const std::vector<Board::Move>& moves,
+             std::vector<Annotation>& out, const Options& options);
+
+  /// Find the legal move on the Board written as text, in the notation
+  /// Board::Move prints.
+  bool parse_move(std::string_view text, Board::Move& move);
+
+  /// Write one line: the FEN, the depth reached, then each move and score.
+  void write(std::ostream& os, const Annotation& annotation);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+Bitboards: one bit per square, bit n is Board square n (rank n/5, file n%5).
+25 squares fit in a uint32_t with room to spare. The high 7 bits are always
+zero; anything that complements a bitboard must mask with ALL.
+*/
+
+namespace Bitboard {
+  typedef uint32_t bitboard;
+
+  constexpr bitboard EMPTY = 0;
+  constexpr bitboard ALL   = (1u << 25) - 1;
+
+  constexpr bitboard RANK_0 = 0x1F; // sente's promotion zone
+  constexpr bitboard RANK_4 = RANK_0 << 20; // gote's promotion zone
+  constexpr bitboard FILE_0 = 0x108421; // squares 0, 5, 10, 15, 20
+
+  constexpr bitboard square_bb(unsigned sq) {
+    return 1u << sq;
+  }
+  constexpr bitboard rank_bb(unsigned rank) {
+    return RANK_0 << (5 * rank);
+  }
+  constexpr bitboard file_bb(unsigned file) {
+    return FILE_0 << file;
+  }
+  /// promotion zone of a Board::color
+  constexpr bitboard promo_zone(bool c) {
+    return c ? RANK_4 : RANK_0;
+  }
+
+  static inline int popcount(bitboard b) {
+    return __builtin_popcount(b);
+  }
+  static inline unsigned lsb(bitboard b) {
+    return __builtin_ctz(b);
+  }
+  static inline unsigned msb(bitboard b) {
+    return 31 - __builtin_clz(b);
+  }
+  /// Remove and return the lowest square in b, which must not be empty.
+  static inline unsigned pop_lsb(bitboard& b) {
+    unsigned sq = lsb(b);
+    b &= b - 1;
+    return sq;
+  }
+  static inline bool more_than_one(bitboard b) {
+    return b & (b - 1);
+  }
+}
@@ -1,5 +1,7 @@
 #include "board.hpp"
 #include "movegen.hpp" // for slow checkmate detection, remove later!
+#include "instrument.hpp"
+#include "fen.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cstring>
@@ -7,14 +9,57 @@
 #include <iterator>
 
 namespace Board {
-  Piece::piece Square[25] = { };
-  bool to_move = false;
+  thread_local uint8_t Square[25] = { };
+  thread_local bool to_move = false;
 
-  std::set<uint8_t> occupancy[2];
-  uint8_t hand[2][Piece::NB_UNPROMOTED]{};
+  thread_local Bitboard::bitboard occupancy_bb[2]{};
+  thread_local uint8_t hand[2][Piece::NB_UNPROMOTED]{};
+  thread_local uint64_t key = 0;
 
   std::vector<color> colors = {SENTE, GOTE};
 
+  /// Random numbers for the Zobrist key, which is the XOR of one for each
+  /// (piece, square), one for each hand count, and one if gote is to move.
+  /// Hand counts above 3 don't occur with real material and share keys.
+  namespace Zobrist {
+    static uint64_t psq[Piece::GOTE | Piece::NB_PIECE_TYPES][25];
+    static uint64_t in_hand[2][Piece::NB_UNPROMOTED][4];
+    static uint64_t gote;
+
+    static int populate() {
+      // splitmix64, so the keys are the same on every platform
+      uint64_t state = 0x5D0B1A5C0FFEEull;
+      auto next = [&state]() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+      };
+      for (auto& piece : psq) for (uint64_t& k : piece) k = next();
+      for (auto& c : in_hand) for (auto& pt : c) for (uint64_t& k : pt) k = next();
+      gote = next();
+      return 0;
+    }
+    static int _unused = populate();
+
+    static inline uint64_t hand_change(color c, Piece::piece_type pt, unsigned from, unsigned to) {
+      return in_hand[c][pt][from & 3] ^ in_hand[c][pt][to & 3];
+    }
+  }
+
+  uint64_t compute_key() {
+    uint64_t k = Board::to_move == GOTE ? Zobrist::gote : 0;
+    for (square sq = 0; sq < 25; ++sq) {
+      if (Board::Square[sq] != Piece::NO_PIECE) k ^= Zobrist::psq[Board::Square[sq]][sq];
+    }
+    for (color c : colors) {
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        k ^= Zobrist::in_hand[c][pt][Board::hand[c][pt] & 3];
+      }
+    }
+    return k;
+  }
+
   Move::Move(square orig, square dest, bool promo)
     : origin(orig), destination(dest), pieceDrop(Piece::NO_PIECE), promotion(promo)
     { }
@@ -38,7 +83,7 @@ namespace Board {
     return os;
   }
 
-  StateInfo *st = NULL;
+  thread_local StateInfo *st = NULL;
   StateInfo::StateInfo() : prev(NULL) { }
 
   /// @brief Evacuate a square, returning the piece that was there.
@@ -47,7 +92,7 @@ namespace Board {
     if (p == Piece::NO_PIECE) return p;
 
     Board::Square[sq] = Piece::NO_PIECE;
-    Board::occupancy[c].erase(sq);
+    Board::occupancy_bb[c] ^= Bitboard::square_bb(sq);
     return p;
   }
   Piece::piece evacuate(square sq) {
@@ -58,23 +103,50 @@ namespace Board {
   /// @brief Occupy a square with the given piece.
   void occupy(square sq, Piece::piece p, color c) {
     Board::Square[sq] = p;
-    Board::occupancy[c].insert(sq);
+    Board::occupancy_bb[c] |= Bitboard::square_bb(sq);
   }
   void occupy(square sq, Piece::piece p) {
     occupy(sq, p, Piece::color(p));
   }
 
+  void clear() {
+    std::memset(Board::Square, 0, sizeof(Board::Square));
+    std::memset(Board::hand, 0, sizeof(Board::hand));
+    for (color c : colors) Board::occupancy_bb[c] = 0;
+    Board::key = compute_key();
+  }
+
+  void set_position(const Position& pos) {
+    clear();
+    for (square sq = 0; sq < 25; ++sq) {
+      if (pos.squares[sq] != Piece::NO_PIECE) occupy(sq, pos.squares[sq]);
+    }
+    std::memcpy(Board::hand, pos.hand, sizeof(Board::hand));
+    Board::to_move = pos.to_move;
+    Board::key = compute_key();
+    Board::st = NULL;
+  }
+
+  void get_position(Position& pos) {
+    for (square sq = 0; sq < 25; ++sq) pos.squares[sq] = Board::Square[sq];
+    std::memcpy(pos.hand, Board::hand, sizeof(pos.hand));
+    pos.to_move = Board::to_move;
+  }
+
   void do_move(Move m, StateInfo& new_st) {
+    COUNT(DO_MOVE);
     // We must treat new_st as being completely invalid and initialize anything
     // that we care about.
     new_st.prev = st;
     new_st.capturedPiece = Piece::NO_PIECE;
+    new_st.null_move = false;
     st = &new_st;
 
     color us = Board::to_move;
     color them = !us;
 
     Board::to_move = them; // swap player to move
+    Board::key ^= Zobrist::gote;
 
     if (m.pieceDrop != Piece::NO_PIECE) {
       // this move is a drop.
@@ -87,7 +159,10 @@ namespace Board {
       assert(Board::hand[us][Piece::type(m.pieceDrop)] > 0);
 
       // Remove one of these from our hand.
-      Board::hand[us][Piece::type(m.pieceDrop)]--;
+      uint8_t& count = Board::hand[us][Piece::type(m.pieceDrop)];
+      Board::key ^= Zobrist::hand_change(us, Piece::type(m.pieceDrop), count, count - 1)
+                  ^ Zobrist::psq[m.pieceDrop][m.destination];
+      count--;
       occupy(m.destination, m.pieceDrop, us);
     }
     else {
@@ -104,11 +179,15 @@ namespace Board {
       Piece::piece moving_piece = evacuate(m.origin, us);
       // Evacuate the destination
       Piece::piece captured_piece = evacuate(m.destination, them);
+      Board::key ^= Zobrist::psq[moving_piece][m.origin];
 
       // If a piece is being captured...
       if (captured_piece != Piece::NO_PIECE) {
         // add one of its unpromoted piece type to our hand
-        Board::hand[us][Piece::upt(captured_piece)]++;
+        uint8_t& count = Board::hand[us][Piece::upt(captured_piece)];
+        Board::key ^= Zobrist::hand_change(us, Piece::upt(captured_piece), count, count + 1)
+                    ^ Zobrist::psq[captured_piece][m.destination];
+        count++;
         st->capturedPiece = captured_piece;
       }
 
@@ -120,13 +199,17 @@ namespace Board {
 
       // Occupy the target square.
       occupy(m.destination, moving_piece, us);
+      Board::key ^= Zobrist::psq[moving_piece][m.destination];
     }
+    st->key = Board::key;
   }
 
   void undo_move(Move m) {
+    COUNT(UNDO_MOVE);
     color them = Board::to_move;
     color us = !them;
     Board::to_move = us;
+    Board::key ^= Zobrist::gote;
 
     if (m.pieceDrop != Piece::NO_PIECE) {
       // undoing a drop.
@@ -136,7 +219,10 @@ namespace Board {
       assert(p == m.pieceDrop);
       // Pick up the piece.
       // (using m.pieceDrop instead of p allows instructions to overlap)
-      Board::hand[us][Piece::type(m.pieceDrop)]++;
+      uint8_t& count = Board::hand[us][Piece::type(m.pieceDrop)];
+      Board::key ^= Zobrist::hand_change(us, Piece::type(m.pieceDrop), count, count + 1)
+                  ^ Zobrist::psq[m.pieceDrop][m.destination];
+      count++;
     }
     else {
       // undoing a proper move.
@@ -144,15 +230,20 @@ namespace Board {
       assert(Board::Square[m.origin] == Piece::NO_PIECE);
       // Evacuate the destination and occupy the origin, possibly demoting.
       Piece::piece p = evacuate(m.destination, us);
+      Board::key ^= Zobrist::psq[p][m.destination];
       if (m.promotion) p = Piece::demote(p);
       occupy(m.origin, p, us);
+      Board::key ^= Zobrist::psq[p][m.origin];
 
       // If this move was a capture, remove the captured piece from our hand
       // and put it back on the destination square with the opponent's color.
       // Take care - the captured piece may have been promoted!
       Piece::piece captured = st->capturedPiece;
       if (captured != Piece::NO_PIECE) {
-        Board::hand[us][Piece::upt(captured)]--;
+        uint8_t& count = Board::hand[us][Piece::upt(captured)];
+        Board::key ^= Zobrist::hand_change(us, Piece::upt(captured), count, count - 1)
+                    ^ Zobrist::psq[captured][m.destination];
+        count--;
         occupy(m.destination, captured, them);
       }
     }
@@ -161,10 +252,46 @@ namespace Board {
     st = st->prev;
   }
 
+  void do_null_move(StateInfo& new_st) {
+    new_st.prev = st;
+    new_st.capturedPiece = Piece::NO_PIECE;
+    new_st.null_move = true;
+    st = &new_st;
+    Board::to_move = !Board::to_move;
+    Board::key ^= Zobrist::gote;
+    st->key = Board::key;
+  }
+
+  void undo_null_move() {
+    Board::to_move = !Board::to_move;
+    Board::key ^= Zobrist::gote;
+    st = st->prev;
+  }
+
+  void save(Snapshot& s) {
+    std::memcpy(s.squares, Board::Square, sizeof(s.squares));
+    std::memcpy(s.hand, Board::hand, sizeof(s.hand));
+    s.to_move = Board::to_move;
+    s.occupancy_bb[SENTE] = Board::occupancy_bb[SENTE];
+    s.occupancy_bb[GOTE] = Board::occupancy_bb[GOTE];
+    s.key = Board::key;
+    s.st = Board::st;
+  }
+
+  void restore(const Snapshot& s) {
+    std::memcpy(Board::Square, s.squares, sizeof(s.squares));
+    std::memcpy(Board::hand, s.hand, sizeof(s.hand));
+    Board::to_move = s.to_move;
+    Board::occupancy_bb[SENTE] = s.occupancy_bb[SENTE];
+    Board::occupancy_bb[GOTE] = s.occupancy_bb[GOTE];
+    Board::key = s.key;
+    Board::st = s.st;
+  }
+
   //bool is_checkmate() {
   //}
 
-  void check_consistency() {
+  bool is_consistent() {
     unsigned counts[Piece::KING+1]{};
 
     for (Board::square sq = 0; sq < 25; ++sq) {
@@ -172,14 +299,15 @@ namespace Board {
       if (p != Piece::NO_PIECE) {
         counts[Piece::upt(p)]++;
         Board::color c = Piece::color(p);
-        assert(Board::occupancy[c].count(sq));
+        if (!(Board::occupancy_bb[c] & Bitboard::square_bb(sq))) return false;
       }
     }
     for (Board::color c : Board::colors) {
-      for (Board::square sq : Board::occupancy[c]) {
-        Piece::piece p = Board::Square[sq];
-        assert(p != Piece::NO_PIECE);
-        assert(Piece::color(p) == c);
+      if (Board::occupancy_bb[c] & ~Bitboard::ALL) return false;
+      for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+        Piece::piece p = Board::Square[Bitboard::pop_lsb(b)];
+        if (p == Piece::NO_PIECE) return false;
+        if (Piece::color(p) != c) return false;
       }
 
       for (int i = Piece::PAWN; i < Piece::NB_UNPROMOTED; ++i) {
@@ -187,12 +315,14 @@ namespace Board {
       }
     }
 
-    assert(counts[Piece::PAWN] == 2);
-    assert(counts[Piece::SILVER] == 2);
-    assert(counts[Piece::GOLD] == 2);
-    assert(counts[Piece::BISHOP] == 2);
-    assert(counts[Piece::ROOK] == 2);
-    assert(counts[Piece::KING] == 2);
+    for (int i = Piece::PAWN; i <= Piece::KING; ++i) {
+      if (counts[i] != 2) return false;
+    }
+    return Board::key == compute_key();
+  }
+
+  void check_consistency() {
+    assert(is_consistent());
   }
 
   bool in_promo_zone(square sq, color c) {
@@ -250,125 +380,19 @@ namespace Board {
 
   /// Print the current position to a std::string in FEN notation.
   std::string exportFEN() {
-    std::ostringstream ss;
-
-    // board part
-    for (unsigned row = 0; row < 5; ++row) {
-      if (row != 0) ss << "/";
-      unsigned blanks = 0;
-      for (int col = 4; col >= 0; --col) {
-        Piece::piece pt = Board::Square[row*5 + col];
-
-        if (pt == Piece::NO_PIECE) {
-          ++blanks;
-        } else {
-          if (blanks != 0) {
-            ss << blanks;
-            blanks = 0;
-          }
-          ss << (Piece::Printable)pt;
-        }
-      }
-      if (blanks != 0) ss << blanks;
-    }
-
-    // player part
-    if (Board::to_move == Board::SENTE) {
-      ss << " b ";
-    } else {
-      ss << " w ";
-    }
-
-    // hand part
-
-    bool empty_hand = true;
-    for (Board::color color : colors) {
-      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
-        for (unsigned count = 0; count < hand[color][pt]; ++count) {
-          ss << (Piece::Printable)Piece::color_piece(pt, color);
-          empty_hand = false;
-        }
-      }
-    }
-    if (empty_hand) ss << "-";
-
-    return ss.str();
+    Position pos;
+    get_position(pos);
+    char buf[Fen::BUFFER_SIZE];
+    return std::string(buf, Fen::write(pos, buf));
   }
 
-  // the "standard" notation is to use +P for T etc, but that doesn't look good
-  // in ascii board outputs and I'd rather make the input and output match. 
   void importFEN(const std::string& FEN) {
-    static Piece::piece piece_table[256] = {
-      ['K'] = Piece::SENTE | Piece::KING,   ['k'] = Piece::GOTE | Piece::KING,
-      ['P'] = Piece::SENTE | Piece::PAWN,   ['p'] = Piece::GOTE | Piece::PAWN,
-      ['T'] = Piece::SENTE | Piece::TOKIN,  ['t'] = Piece::GOTE | Piece::TOKIN,
-      ['S'] = Piece::SENTE | Piece::SILVER, ['s'] = Piece::GOTE | Piece::SILVER,
-      ['N'] = Piece::SENTE | Piece::P_SILVER, ['n'] = Piece::GOTE | Piece::P_SILVER,
-      ['G'] = Piece::SENTE | Piece::GOLD,   ['g'] = Piece::GOTE | Piece::GOLD,
-      ['B'] = Piece::SENTE | Piece::BISHOP, ['b'] = Piece::GOTE | Piece::BISHOP,
-      ['R'] = Piece::SENTE | Piece::ROOK,   ['r'] = Piece::GOTE | Piece::ROOK,
-      ['H'] = Piece::SENTE | Piece::HORSE,  ['h'] = Piece::GOTE | Piece::HORSE,
-      ['D'] = Piece::SENTE | Piece::DRAGON, ['d'] = Piece::GOTE | Piece::DRAGON,
-    };
-
-    std::string s = FEN;
-    auto pos = s.find(" ");
-    std::string boardFEN  = s.substr(0, pos);
-    s = s.substr(pos + 1);
-    pos = s.find(" ");
-    std::string playerFEN = s.substr(0, pos);
-    s = s.substr(pos + 1);
-    std::string handFEN = s;
-
-    int file = 4;
-    int rank = 0;
-
-    std::memset(Board::Square, 0, sizeof(Board::Square));
-    for (char c : boardFEN) {
-      if (c == '/') {
-        if (file != -1) throw std::invalid_argument("not 5 items in rank");
-        file = 4;
-        ++rank;
-        continue;
-      }
-
-      if (c >= '1' && c <= '5') {
-        file -= (c - '0');
-      } else {
-        Piece::piece pt = piece_table[c];
-        if (pt == Piece::NO_PIECE || file < 0 || rank > 4) {
-          throw std::invalid_argument("invalid FEN item (board)");
-        }
-        Board::square sq = rank * 5 + file;
-        Board::Square[sq] = pt;
-        Board::occupancy[Piece::color(pt)].insert(sq);
-        --file;
-      }
-    }
-
-    if (playerFEN.length() != 1 ||
-        (playerFEN[0] != 'b' &&
-         playerFEN[0] != 'w'))
-    {
-      std::cerr << playerFEN;
-      throw std::invalid_argument("malformed player-to-move");
-    } else if (playerFEN[0] == 'b') {
-      Board::to_move = false;
-    } else if (playerFEN[0] == 'w') {
-      Board::to_move = true;
-    }
-
-    std::memset(Board::hand, 0, sizeof(Board::hand));
-    if (handFEN.length() != 1 || handFEN[0] != '-') {
-      for (char c : handFEN) {
-        Piece::piece pt = piece_table[c];
-        if (pt == Piece::NO_PIECE || pt & Piece::PROMOTED) {
-          throw std::invalid_argument("invalid FEN item (hand)");
-        }
-
-        Board::hand[Piece::color(pt)][Piece::type(pt)]++;
-      }
+    Position pos;
+    Fen::error err = Fen::parse(FEN, pos);
+    if (err != Fen::OK) {
+      throw std::invalid_argument(Fen::describe(err));
     }
+    set_position(pos);
   }
 
   std::string startFEN = "rbsgk/4p/5/P4/KGSBR b -";
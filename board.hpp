@@ -1,37 +1,46 @@
 #pragma once
 
 #include "piece.hpp"
+#include "bitboard.hpp"
 #include <cstdint>
 #include <iostream>
+#include <type_traits>
 #include <vector>
-#include <set>
 
 /*
 Definitions of the board and supporting types, as well as the
 board object on which moves will be played out.
+
+The board is thread_local: every thread has its own, so searches and games
+can run concurrently on separate threads without sharing any state.
 */
 
 namespace Board {
-  extern Piece::piece Square[25];
+  extern thread_local uint8_t Square[25]; // Piece::piece of each square
   typedef uint8_t square;
 
   /// Colors in general are just one bit. Piece::SENTE and Piece::GOTE are bitfields,
   /// not usually what we want. So we make Board::SENTE and Board::GOTE too.
   typedef bool color;
-  extern color to_move; // false=SENTE, true=GOTE
+  extern thread_local color to_move; // false=SENTE, true=GOTE
   constexpr color SENTE = false;
   constexpr color GOTE = true;
   extern std::vector<color> colors;
 
-  /// **sorted** square indices for the pieces of each color.
-  /// must be kept consistent with [square]!
-  /// Indexed by color, then vector is of indices.
-  extern std::set<square> occupancy[2];
+  /// Squares occupied by the pieces of each color.
+  /// must be kept consistent with [Square]!
+  extern thread_local Bitboard::bitboard occupancy_bb[2];
 
   /// player hands: count of pieces of each (unpromoted) type.
   /// For convenience, hand[x][0] is always 0 (corresponds to NO_PIECE).
   /// Indexed by color, then piece type.
-  extern uint8_t hand[2][Piece::NB_UNPROMOTED];
+  extern thread_local uint8_t hand[2][Piece::NB_UNPROMOTED];
+
+  /// Zobrist key of the current position: squares, hands and player to move.
+  /// do_move and undo_move keep it up to date. Anything that writes the
+  /// fields above directly must reset it with key = compute_key().
+  extern thread_local uint64_t key;
+  uint64_t compute_key();
 
 
   /// We can store moves in relatively few bits but use a
@@ -45,35 +54,127 @@ namespace Board {
     uint8_t pieceDrop;  // What piece is being dropped?
     bool promotion;     // moving piece is promoting?
 
-    //Move() = default;
+    /// Move() is no move at all; it is never generated.
+    Move() = default;
     Move(square orig, square dest, bool promo = false);
     Move(square dest, Piece::piece_type pt);
 
+    bool operator==(const Move& other) const {
+      return origin == other.origin && destination == other.destination
+          && pieceDrop == other.pieceDrop && promotion == other.promotion;
+    }
+    bool operator!=(const Move& other) const { return !(*this == other); }
+
     friend std::ostream& operator<<(std::ostream& os, const Move& move);
   };
 
   /// There is some extra state associated with a board, in particular with the
   /// last move. More can easily be added here in the future. For now, we track
   /// what piece the previous move captured (perhaps none!) so that we can undo
-  /// moves later.
-  /// StateInfo objects form a linked list which will generally consist entirely
-  /// of stack objects.
+  /// moves later, and the key of the position the move led to so that
+  /// repetitions can be found by walking back through the list.
+  /// StateInfo objects form a linked list. In search and perft it runs
+  /// through the per-thread search stack (see stack.hpp), one frame per ply.
   class StateInfo {
   public:
     StateInfo *prev;
     Piece::piece capturedPiece = Piece::NO_PIECE;
+    uint64_t key = 0;
+    /// Is the player to move in check after this move? do_move doesn't know;
+    /// callers that care about perpetual check fill it in.
+    bool in_check = false;
+    /// Was this a pass (see do_null_move)? Repetitions don't count across one.
+    bool null_move = false;
 
     StateInfo();
     StateInfo(StateInfo& si) = default;
     StateInfo(StateInfo&& si) = default;
   };
-  extern StateInfo *st;
+  extern thread_local StateInfo *st;
+
+  /// A position by value, without any of the Board's derived state. Cheap
+  /// to copy around, e.g. by parsers that can't touch the Board.
+  struct Position {
+    uint8_t squares[25];
+    uint8_t hand[2][Piece::NB_UNPROMOTED];
+    color to_move;
+  };
+  /// Set up the Board from pos, with no move history.
+  void set_position(const Position& pos);
+  /// Copy the Board's position into pos.
+  void get_position(Position& pos);
+
+  /// Remove every piece from the board and both hands.
+  void clear();
+  /// Put a piece on an empty square.
+  void occupy(square sq, Piece::piece p);
 
   void do_move(Move m, StateInfo& new_st);
   void undo_move(Move m);
+  /// Pass the move to the other player without moving anything. Never
+  /// legal; search uses it for null-move pruning.
+  void do_null_move(StateInfo& new_st);
+  void undo_null_move();
+
+  /// Everything do_move changes, as one small trivially copyable block.
+  /// Copy-make saves it before a move and restores it instead of calling
+  /// undo_move.
+  struct Snapshot {
+    uint8_t squares[25];
+    uint8_t hand[2][Piece::NB_UNPROMOTED];
+    color to_move;
+    Bitboard::bitboard occupancy_bb[2];
+    uint64_t key;
+    StateInfo *st;
+  };
+  static_assert(std::is_trivially_copyable_v<Snapshot>,
+                "Snapshot is saved and restored raw");
+  void save(Snapshot& s);
+  void restore(const Snapshot& s);
+
+  /// Make a move so that it can be taken back, either with undo_move or by
+  /// copy-make, chosen at compile time. Either way the StateInfo list is
+  /// kept, since repetition detection walks it.
+  template <bool CopyMake>
+  inline void make(Move m, StateInfo& si, Snapshot& saved) {
+    if constexpr (CopyMake) save(saved);
+    do_move(m, si);
+  }
+  template <bool CopyMake>
+  inline void unmake(Move m, const Snapshot& saved) {
+    if constexpr (CopyMake) {
+      restore(saved);
+    } else {
+      undo_move(m);
+    }
+  }
+
+  /// make and unmake with their own StateInfo and Snapshot, for callers
+  /// without a search stack (see stack.hpp).
+  template <bool CopyMake>
+  struct Maker {
+    StateInfo si;
+    Snapshot saved;
+
+    void make(Move m) { Board::make<CopyMake>(m, si, saved); }
+    void unmake(Move m) { Board::unmake<CopyMake>(m, saved); }
+  };
+#ifdef COPY_MAKE
+  constexpr bool COPY_MAKE_DEFAULT = true;
+#else
+  constexpr bool COPY_MAKE_DEFAULT = false;
+#endif
+  /// How the search takes moves back; build with `make COPY_MAKE=1` for
+  /// copy-make.
+  typedef Maker<COPY_MAKE_DEFAULT> DefaultMaker;
 
   bool is_checkmate();
 
+  /// Is the board internally consistent? That is, do [occupancy_bb] and
+  /// [Square] agree, is all the material accounted for, and is [key] up to
+  /// date? Never aborts, so harnesses can report a failing position instead
+  /// of dying on an assertion.
+  bool is_consistent();
   void check_consistency();
 
   bool in_promo_zone(square sq, color c);
@@ -82,8 +183,8 @@ namespace Board {
 
   std::string exportFEN();
 
-  /* Throws illegal_argument if something is wrong.
-    The board may still be modified in that case! */
+  /* Throws invalid_argument if something is wrong; the Board is not
+    modified in that case. See fen.hpp for a non-throwing parser. */
   void importFEN(const std::string& FEN);
   extern std::string startFEN;
 }
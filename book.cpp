@@ -0,0 +1,105 @@
+#include "book.hpp"
+#include "movegen.hpp"
+#include "packed.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace Book {
+  static Packed::Reader<Entry> book;
+  // Entries are the same size as packed positions, so books need their own
+  // magic for load() to tell them apart.
+  static const char MAGIC[8] = {'T', 'S', 'H', 'O', 'B', 'K', '0', '1'};
+
+  static inline bool operator<(const Entry& a, const Entry& b) {
+    if (a.key != b.key) return a.key < b.key;
+    uint32_t ma, mb;
+    std::memcpy(&ma, &a.move, sizeof(ma));
+    std::memcpy(&mb, &b.move, sizeof(mb));
+    return ma < mb;
+  }
+
+  bool load(const std::string& path) {
+    book = Packed::Reader<Entry>();
+    return book.open(path, MAGIC);
+  }
+
+  /// The book's entries for the Board's key.
+  static std::pair<const Entry *, const Entry *> find() {
+    auto by_key = [](const Entry& e, uint64_t key) { return e.key < key; };
+    const Entry *first = std::lower_bound(book.begin(), book.end(), Board::key, by_key);
+    const Entry *last = first;
+    while (last != book.end() && last->key == Board::key) ++last;
+    return {first, last};
+  }
+
+  std::vector<Entry> entries() {
+    auto [first, last] = find();
+    return std::vector<Entry>(first, last);
+  }
+
+  bool probe(std::mt19937_64& rng, Board::Move& move) {
+    auto [first, last] = find();
+    uint64_t total = 0;
+    for (const Entry *e = first; e != last; ++e) total += e->weight;
+    if (total == 0) return false;
+
+    uint64_t pick = rng() % total;
+    const Entry *e = first;
+    for ( ; pick >= e->weight; ++e) pick -= e->weight;
+
+    // a different position with the same key would be very unlucky, but
+    // it mustn't make us play an illegal move.
+    std::vector<Board::Move> moves = Movegen::legal();
+    if (std::find(moves.begin(), moves.end(), e->move) == moves.end()) return false;
+    move = e->move;
+    return true;
+  }
+
+  static void expand(
+    int plies_left, const Options& options,
+    std::unordered_set<uint64_t>& seen, std::vector<Entry>& out
+  ) {
+    if (plies_left == 0 || !seen.insert(Board::key).second) return;
+    uint64_t key = Board::key;
+
+    std::vector<Board::Move> moves = Movegen::legal();
+    std::vector<Search::value> scores;
+    for (Board::Move m : moves) {
+      Board::DefaultMaker maker;
+      maker.make(m);
+      scores.push_back(-Search::search(options.limits).score);
+      maker.unmake(m);
+    }
+    if (moves.empty()) return;
+
+    Search::value best = *std::max_element(scores.begin(), scores.end());
+    for (size_t i = 0; i < moves.size(); ++i) {
+      if (scores[i] < best - options.margin) continue;
+      out.push_back(Entry{key, moves[i], uint32_t(options.margin + 1 - (best - scores[i]))});
+
+      Board::DefaultMaker maker;
+      maker.make(moves[i]);
+      expand(plies_left - 1, options, seen, out);
+      maker.unmake(moves[i]);
+    }
+  }
+
+  bool build(const std::string& path, const Options& options, std::ostream& log) {
+    Board::importFEN(Board::startFEN);
+    Search::clear();
+
+    std::unordered_set<uint64_t> seen;
+    std::vector<Entry> out;
+    expand(options.plies, options, seen, out);
+    std::sort(out.begin(), out.end());
+
+    Packed::Writer<Entry> writer(path, MAGIC);
+    if (!writer.is_open()) return false;
+    for (const Entry& e : out) writer.write(e);
+    if (!writer.close()) return false;
+    log << "book has " << out.size() << " moves in " << seen.size() << " positions"
+        << std::endl;
+    return true;
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "board.hpp"
+#include "search.hpp"
+#include <iostream>
+#include <random>
+#include <string>
+
+/*
+Opening book: weighted moves for positions near the start, looked up by
+Zobrist key.
+
+A book is a Packed record file (see packed.hpp) of Entries sorted by key,
+then move. Loading just maps it; probing binary searches the mapping and
+picks one of the position's moves at random, in proportion to the weights.
+Like the tablebases, one book is loaded for the whole process and may be
+probed from any thread.
+*/
+
+namespace Book {
+  struct Entry {
+    uint64_t key;
+    Board::Move move;
+    uint32_t weight;
+  };
+  static_assert(sizeof(Entry) == 16, "Entry should stay 16 bytes");
+
+  /// Map a book file, replacing any book already loaded.
+  bool load(const std::string& path);
+  /// Pick a book move for the Board. Returns false if the position isn't
+  /// in the book (or the book is empty).
+  bool probe(std::mt19937_64& rng, Board::Move& move);
+  /// Every move the book has for the Board.
+  std::vector<Entry> entries();
+
+  struct Options {
+    int plies = 6;       // how deep the book goes from startFEN
+    Search::Limits limits; // for scoring each move
+    int margin = 40;     // keep moves scoring this close to the best
+  };
+
+  /// Build a book by search: from startFEN, score every legal move with a
+  /// search of the position after it, keep the ones within margin of the
+  /// best, and expand those. Weights fall off linearly with the distance
+  /// from the best score. Returns false if the book can't be written.
+  bool build(const std::string& path, const Options& options, std::ostream& log);
+}
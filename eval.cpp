@@ -0,0 +1,18 @@
+#include "eval.hpp"
+
+namespace Eval {
+  value evaluate() {
+    value score[2] = {0, 0};
+    for (Board::color c : Board::colors) {
+      for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+        Board::square sq = Bitboard::pop_lsb(b);
+        Piece::piece_type pt = Piece::type(Board::Square[sq]);
+        score[c] += piece_value[pt] + psq[pt][relative_square(c, sq)];
+      }
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        score[c] += hand_value[pt] * Board::hand[c][pt];
+      }
+    }
+    return score[Board::to_move] - score[!Board::to_move];
+  }
+}
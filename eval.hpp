@@ -0,0 +1,23 @@
+#pragma once
+
+#include "board.hpp"
+#include "weights.hpp"
+
+/*
+Static evaluation: material on the board and in hand, plus piece-square
+bonuses. It is linear in the weights of weights.hpp, which `./main tune`
+fits to self-play results (see tune.hpp).
+*/
+
+namespace Eval {
+  typedef int value;
+
+  /// Evaluate the Board, in centipawns for the player to move.
+  value evaluate();
+
+  /// The square a piece of color c on sq uses in psq[]: gote's side of the
+  /// board is sente's turned around.
+  static inline Board::square relative_square(Board::color c, Board::square sq) {
+    return c == Board::SENTE ? sq : 24 - sq;
+  }
+}
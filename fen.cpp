@@ -0,0 +1,228 @@
+#include "fen.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+namespace Fen {
+
+  // the "standard" notation is to use +P for T etc, but that doesn't look good
+  // in ascii board outputs and I'd rather make the input and output match.
+  static constexpr char letters[] = "psgbrk\0\0tn\0hd"; // indexed by type - 1
+
+  /// How to write a rank, given which of its squares are occupied. Each
+  /// token is either a digit, or a file (< 5) whose piece letter goes there.
+  struct RankPattern {
+    char token[5];
+    uint8_t length;
+  };
+
+  struct Tables {
+    uint8_t piece[256]; // piece for each character, NO_PIECE if not a piece
+    uint8_t step[256];  // files a board character covers; 0 if invalid
+    char letter[Piece::GOTE | Piece::NB_PIECE_TYPES]; // indexed by piece
+    RankPattern rank[32]; // indexed by occupied files, bit n is file n
+  };
+
+  static constexpr Tables make_tables() {
+    Tables t{};
+    for (Piece::piece pt = Piece::PAWN; pt < Piece::NB_PIECE_TYPES; ++pt) {
+      char c = letters[pt - 1];
+      if (c == 0) continue;
+      char upper = c - 'a' + 'A';
+      t.piece[(unsigned char)c] = Piece::GOTE | pt;
+      t.piece[(unsigned char)upper] = Piece::SENTE | pt;
+      t.step[(unsigned char)c] = t.step[(unsigned char)upper] = 1;
+      t.letter[Piece::GOTE | pt] = c;
+      t.letter[Piece::SENTE | pt] = upper;
+    }
+    for (char n = '1'; n <= '5'; ++n) t.step[(unsigned char)n] = n - '0';
+
+    for (unsigned occupied = 0; occupied < 32; ++occupied) {
+      RankPattern& r = t.rank[occupied];
+      char blanks = 0;
+      for (int file = 4; file >= 0; --file) {
+        if (occupied & (1 << file)) {
+          if (blanks) r.token[r.length++] = '0' + blanks;
+          r.token[r.length++] = file;
+          blanks = 0;
+        } else {
+          ++blanks;
+        }
+      }
+      if (blanks) r.token[r.length++] = '0' + blanks;
+    }
+    return t;
+  }
+  static constexpr Tables tables = make_tables();
+
+  const char *describe(error e) {
+    switch (e) {
+      case OK:         return "ok";
+      case BAD_BOARD:  return "invalid FEN item (board)";
+      case BAD_RANKS:  return "not 5 ranks";
+      case BAD_PLAYER: return "malformed player-to-move";
+      case BAD_HAND:   return "invalid FEN item (hand)";
+      case TRUNCATED:  return "FEN is missing a field";
+    }
+    return "unknown error";
+  }
+
+  error parse(std::string_view fen, Board::Position& pos) {
+    const char *p = fen.data();
+    const char *end = p + fen.size();
+    while (end > p && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n')) --end;
+
+    std::memset(&pos, 0, sizeof(pos));
+
+    // board part. Pieces and runs of blanks are handled alike: a piece
+    // covers one file, and blanks store NO_PIECE over the first of theirs.
+    int rank = 0, file = 4;
+    for ( ; p < end && *p != ' '; ++p) {
+      unsigned char c = *p;
+      if (c == '/') {
+        if (file != -1) return BAD_BOARD;
+        if (++rank > 4) return BAD_RANKS;
+        file = 4;
+        continue;
+      }
+      int step = tables.step[c];
+      if (step == 0 || step > file + 1) return BAD_BOARD;
+      pos.squares[rank * 5 + file] = tables.piece[c];
+      file -= step;
+    }
+    if (rank != 4) return BAD_RANKS;
+    if (file != -1) return BAD_BOARD;
+
+    // player part
+    if (end - p < 3) return TRUNCATED;
+    if (p[1] == 'b') {
+      pos.to_move = Board::SENTE;
+    } else if (p[1] == 'w') {
+      pos.to_move = Board::GOTE;
+    } else {
+      return BAD_PLAYER;
+    }
+    if (p[2] != ' ') return BAD_PLAYER;
+    p += 3;
+
+    // hand part
+    if (p == end) return TRUNCATED;
+    if (end - p == 1 && *p == '-') return OK;
+    for ( ; p < end; ++p) {
+      Piece::piece pt = tables.piece[(unsigned char)*p];
+      Piece::piece_type type = pt & Piece::PIECE_TYPE_MASK;
+      if (pt == Piece::NO_PIECE || type >= Piece::NB_UNPROMOTED) return BAD_HAND;
+      // there are only two of each piece in the game, so hands can't hold
+      // more. write() and the buffers it fills rely on this.
+      if (pos.hand[Board::SENTE][type] + pos.hand[Board::GOTE][type] >= 2) return BAD_HAND;
+      pos.hand[(pt & Piece::GOTE) != 0][type]++;
+    }
+    return OK;
+  }
+
+  // Written without data-dependent branches: whether a square is empty is
+  // a coin flip, and mispredicting it dominated the cost of writing. Each
+  // rank writes all 5 characters of its pattern and then advances by the
+  // pattern's length, and likewise for the hand.
+  size_t write(const Board::Position& pos, char *buf) {
+    char *out = buf;
+
+    // board part
+    for (unsigned row = 0; row < 5; ++row) {
+      const uint8_t *squares = pos.squares + row * 5;
+      unsigned occupied = 0;
+      for (unsigned file = 0; file < 5; ++file) {
+        occupied |= (squares[file] != Piece::NO_PIECE) << file;
+      }
+
+      const RankPattern& r = tables.rank[occupied];
+      for (unsigned i = 0; i < 5; ++i) {
+        char token = r.token[i];
+        char letter = tables.letter[squares[token < 5 ? token : 0]];
+        out[i] = token < 5 ? letter : token;
+      }
+      out += r.length;
+      *out = '/';
+      out += row != 4;
+    }
+
+    // player part
+    *out++ = ' ';
+    *out++ = pos.to_move == Board::SENTE ? 'b' : 'w';
+    *out++ = ' ';
+
+    // hand part. There are never more than two of a piece (parse rejects
+    // more), so writing two letters and advancing by the count is enough.
+    char *hand_start = out;
+    for (Board::color c : {Board::SENTE, Board::GOTE}) {
+      char base = c == Board::SENTE ? Piece::SENTE : Piece::GOTE;
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        unsigned count = pos.hand[c][pt];
+        char letter = tables.letter[base | pt];
+        assert(count <= 2);
+        out[0] = out[1] = letter;
+        out += count;
+      }
+    }
+    *out = '-';
+    out += out == hand_start;
+
+    return out - buf;
+  }
+
+  /// Parse every line in text, appending to out. Returns the number of
+  /// lines that failed.
+  static size_t parse_lines(std::string_view text, std::vector<Board::Position>& out) {
+    size_t failures = 0;
+    Board::Position pos;
+    while (!text.empty()) {
+      size_t eol = text.find('\n');
+      std::string_view line = text.substr(0, eol);
+      text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+      if (line.empty() || line == "\r") continue;
+      if (parse(line, pos) == OK) {
+        out.push_back(pos);
+      } else {
+        ++failures;
+      }
+    }
+    return failures;
+  }
+
+  size_t parse_batch(std::string_view text, std::vector<Board::Position>& out,
+                     unsigned nb_threads) {
+    if (nb_threads <= 1) return parse_lines(text, out);
+
+    // split at the first newline after each even share of the buffer.
+    std::vector<std::string_view> chunks;
+    size_t chunk_size = text.size() / nb_threads + 1;
+    while (!text.empty()) {
+      size_t cut = text.find('\n', std::min(chunk_size, text.size()) - 1);
+      cut = cut == std::string_view::npos ? text.size() : cut + 1;
+      chunks.push_back(text.substr(0, cut));
+      text.remove_prefix(cut);
+    }
+
+    std::vector<std::vector<Board::Position>> results(chunks.size());
+    std::vector<size_t> failures(chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      threads.emplace_back([&, i]() {
+        // a FEN line is 20-50 bytes, so this is about right.
+        results[i].reserve(chunks[i].size() / 24);
+        failures[i] = parse_lines(chunks[i], results[i]);
+      });
+    }
+
+    size_t total_failures = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      threads[i].join();
+      out.insert(out.end(), results[i].begin(), results[i].end());
+      total_failures += failures[i];
+    }
+    return total_failures;
+  }
+}
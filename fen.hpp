@@ -0,0 +1,47 @@
+#pragma once
+
+#include "board.hpp"
+#include <string_view>
+#include <vector>
+
+/*
+Fast FEN parsing and formatting, for ingesting and writing large text files
+of positions. Nothing here allocates or throws: the parser reports errors
+as codes and the writer formats into a caller-supplied buffer.
+Board::importFEN and Board::exportFEN are thin wrappers around these.
+*/
+
+namespace Fen {
+  enum error {
+    OK,
+    BAD_BOARD,  // unknown piece letter, or rank not exactly 5 squares
+    BAD_RANKS,  // not exactly 5 ranks
+    BAD_PLAYER, // player to move is not 'b' or 'w'
+    BAD_HAND,   // unknown or promoted piece in hand, or more than 2 of a kind
+    TRUNCATED,  // missing a field
+  };
+
+  const char *describe(error e);
+
+  /// Longest FEN we write: 25 squares, 4 slashes, " b ", and at most two
+  /// of each of the 5 hand pieces in each hand, 20 in all. parse never
+  /// accepts more than that, so its output always fits.
+  constexpr size_t MAX_LENGTH = 52;
+  /// write() may store a few characters past the end of what it returns,
+  /// so buffers it writes into need this much room.
+  constexpr size_t BUFFER_SIZE = MAX_LENGTH + 8;
+
+  /// Parse a FEN into pos. Trailing whitespace (including '\r') is ignored.
+  error parse(std::string_view fen, Board::Position& pos);
+
+  /// Write the FEN of pos into buf, which must have room for BUFFER_SIZE
+  /// characters. Returns the number written; no terminator is added.
+  size_t write(const Board::Position& pos, char *buf);
+
+  /// Parse a whole buffer of newline-separated FENs, split into chunks at
+  /// line boundaries and parsed on nb_threads threads. Positions are
+  /// appended to out in input order; blank lines are skipped, and so are
+  /// lines that fail to parse. Returns the number of lines that failed.
+  size_t parse_batch(std::string_view text, std::vector<Board::Position>& out,
+                     unsigned nb_threads);
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "movegen.hpp"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+
+/* Header-only differential fuzzer for movegen.
+
+Random-walks from startFEN and from random legal positions. At every node,
+the output of the generators under test is compared against
+reference_legal(), and the board is checked for consistency. When something
+disagrees, the failure is shrunk to a minimal FEN plus move sequence that
+still reproduces it, so it can be pasted straight into main.
+*/
+
+namespace Movegen {
+namespace Fuzz {
+
+struct Failure {
+  std::string root;              // FEN the failing line starts from
+  std::vector<Board::Move> line; // moves played from root
+  std::string fen;               // FEN at the failing node
+  std::string reason;
+};
+
+// moves have no ordering, so compare them by their bytes.
+static inline uint32_t move_key(Board::Move m) {
+  uint32_t key;
+  static_assert(sizeof(m) == sizeof(key), "Move is no longer 4 bytes");
+  std::memcpy(&key, &m, sizeof(key));
+  return key;
+}
+
+static inline std::vector<uint32_t> sorted_keys(const std::vector<Board::Move>& moves) {
+  std::vector<uint32_t> keys;
+  for (Board::Move m : moves) keys.push_back(move_key(m));
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+/// Check the current node. Returns a description of the first problem found,
+/// or the empty string if everything agrees.
+std::string check_node() {
+  if (!Board::is_consistent()) return "board is inconsistent";
+
+  std::vector<Board::Move> expected = reference_legal();
+  std::vector<Board::Move> actual = legal();
+  if (sorted_keys(expected) != sorted_keys(actual)) {
+    std::ostringstream ss;
+    ss << "legal() has " << actual.size() << " moves, reference has "
+       << expected.size();
+    return ss.str();
+  }
+
+  // the typed generators must partition the legal moves.
+  std::vector<Board::Move> parts = generate<CAPTURES>();
+  for (Board::Move m : generate<QUIETS>()) parts.push_back(m);
+  for (Board::Move m : generate<DROPS>()) parts.push_back(m);
+  if (sorted_keys(expected) != sorted_keys(parts)) {
+    std::ostringstream ss;
+    ss << "captures, quiets and drops have " << parts.size()
+       << " moves, reference has " << expected.size();
+    return ss.str();
+  }
+
+  size_t counted = count_legal();
+  if (counted != expected.size()) {
+    std::ostringstream ss;
+    ss << "count_legal() is " << counted << ", reference has "
+       << expected.size() << " moves";
+    return ss.str();
+  }
+
+  return "";
+}
+
+/// Import root and play line, then check the final node. Returns true if the
+/// failure reproduces; if any move in line is not legal, it doesn't.
+bool reproduces(const std::string& root, const std::vector<Board::Move>& line,
+                std::string& reason) {
+  Board::importFEN(root);
+  std::vector<Board::StateInfo> si(line.size());
+
+  size_t played = 0;
+  bool failed = false;
+  for ( ; played < line.size(); ++played) {
+    std::vector<uint32_t> keys = sorted_keys(reference_legal());
+    if (!std::binary_search(keys.begin(), keys.end(), move_key(line[played]))) {
+      break;
+    }
+    Board::do_move(line[played], si[played]);
+  }
+  if (played == line.size()) {
+    reason = check_node();
+    failed = !reason.empty();
+  }
+
+  while (played > 0) {
+    --played;
+    Board::undo_move(line[played]);
+  }
+  return failed;
+}
+
+/// Shrink a failure. First look for the latest intermediate position which
+/// still fails when imported directly (usually the failing node itself),
+/// then try dropping each remaining move in turn.
+void shrink(Failure& f) {
+  std::string reason;
+
+  // FENs of every position along the line, so we can restart from them.
+  std::vector<std::string> fens;
+  Board::importFEN(f.root);
+  std::vector<Board::StateInfo> si(f.line.size());
+  for (size_t i = 0; i < f.line.size(); ++i) {
+    fens.push_back(Board::exportFEN());
+    Board::do_move(f.line[i], si[i]);
+  }
+  fens.push_back(Board::exportFEN());
+  for (size_t i = f.line.size(); i > 0; --i) Board::undo_move(f.line[i-1]);
+
+  for (size_t start = f.line.size() + 1; start-- > 0; ) {
+    std::vector<Board::Move> suffix(f.line.begin() + start, f.line.end());
+    if (reproduces(fens[start], suffix, reason)) {
+      f.root = fens[start];
+      f.line = suffix;
+      f.reason = reason;
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < f.line.size(); ) {
+    std::vector<Board::Move> smaller = f.line;
+    smaller.erase(smaller.begin() + i);
+    if (reproduces(f.root, smaller, reason)) {
+      f.line = smaller;
+      f.reason = reason;
+    } else {
+      ++i;
+    }
+  }
+
+  std::vector<Board::StateInfo> end_si(f.line.size());
+  for (size_t i = 0; i < f.line.size(); ++i) Board::do_move(f.line[i], end_si[i]);
+  f.fen = Board::exportFEN();
+  for (size_t i = f.line.size(); i > 0; --i) Board::undo_move(f.line[i-1]);
+}
+
+/// Generate a random legal position with the full set of material. Pieces are
+/// scattered over the board and both hands; pawns respect nifu and are never
+/// left unpromoted on their last rank, and the player not to move is never
+/// in check.
+std::string random_position(std::mt19937_64& rng) {
+  for (;;) {
+    std::memset(Board::Square, 0, sizeof(Board::Square));
+    std::memset(Board::hand, 0, sizeof(Board::hand));
+
+    auto empty_square = [&rng]() {
+      Board::square sq;
+      do { sq = rng() % 25; } while (Board::Square[sq] != Piece::NO_PIECE);
+      return sq;
+    };
+    auto place = [](Board::square sq, Piece::piece p) {
+      Board::Square[sq] = p;
+    };
+
+    for (Board::color c : Board::colors) {
+      place(empty_square(), Piece::color_piece(Piece::KING, c));
+    }
+
+    for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+      for (int copy = 0; copy < 2; ++copy) {
+        Board::color owner = rng() & 1;
+        // a third of the pieces go in hand.
+        if (rng() % 3 == 0) {
+          Board::hand[owner][pt]++;
+          continue;
+        }
+
+        Board::square sq = empty_square();
+        Piece::piece p = Piece::color_piece(pt, owner);
+        if (Piece::can_promote(pt) && rng() % 4 == 0) p = Piece::promote(p);
+
+        if (p == Piece::color_piece(Piece::PAWN, owner)) {
+          bool nifu = false;
+          for (Board::square other = sq % 5; other < 25; other += 5) {
+            nifu |= Board::Square[other] == p;
+          }
+          if (nifu || Board::in_promo_zone(sq, owner)) {
+            Board::hand[owner][pt]++;
+            continue;
+          }
+        }
+        place(sq, p);
+      }
+    }
+
+    Board::to_move = rng() & 1;
+    // round trip through FEN to set up everything besides the squares.
+    Board::importFEN(Board::exportFEN());
+    // the player to move must not already be attacking the enemy king.
+    if (is_check(king_sq(!Board::to_move))) continue;
+
+    return Board::exportFEN();
+  }
+}
+
+/// Random-walk up to [plies] moves from root, checking every node.
+/// Returns false and fills in [f] on the first failure.
+bool walk(const std::string& root, int plies, std::mt19937_64& rng, Failure& f) {
+  Board::importFEN(root);
+  std::vector<Board::Move> line;
+  std::vector<Board::StateInfo> si(plies);
+
+  bool ok = true;
+  for (int ply = 0; ; ++ply) {
+    std::string reason = check_node();
+    if (!reason.empty()) {
+      f.root = root;
+      f.line = line;
+      f.fen = Board::exportFEN();
+      f.reason = reason;
+      ok = false;
+      break;
+    }
+
+    if (ply == plies) break;
+    std::vector<Board::Move> moves = reference_legal();
+    if (moves.empty()) break;
+
+    Board::Move m = moves[rng() % moves.size()];
+    Board::do_move(m, si[ply]);
+    line.push_back(m);
+  }
+
+  for (size_t i = line.size(); i > 0; --i) Board::undo_move(line[i-1]);
+  return ok;
+}
+
+/// Run [walks] random walks of up to [plies] moves each, alternating between
+/// startFEN and random positions as roots. Reports (shrunk) failures on
+/// std::cout and returns how many there were.
+uint64_t fuzz(uint64_t seed, uint64_t walks, int plies) {
+  std::mt19937_64 rng(seed);
+  uint64_t failures = 0;
+
+  for (uint64_t i = 0; i < walks; ++i) {
+    std::string root = (i % 2 == 0) ? Board::startFEN : random_position(rng);
+
+    Failure f;
+    if (walk(root, plies, rng, f)) continue;
+
+    ++failures;
+    shrink(f);
+    std::cout << "FAIL (walk " << i << ", seed " << seed << "): "
+              << f.reason << std::endl;
+    std::cout << "  root: " << f.root << std::endl;
+    std::cout << "  line:";
+    for (Board::Move m : f.line) std::cout << " " << m;
+    std::cout << std::endl;
+    std::cout << "  fen:  " << f.fen << std::endl;
+  }
+
+  std::cout << "fuzz: " << walks << " walks, " << failures << " failures"
+            << std::endl;
+  return failures;
+}
+
+}
+}
@@ -0,0 +1,56 @@
+#include "instrument.hpp"
+
+#ifdef INSTRUMENT
+#include <cstring>
+#include <iomanip>
+#include <x86intrin.h>
+
+namespace Instrument {
+  uint64_t counters[NB_COUNTERS]{};
+  uint64_t cycles[NB_TIMERS]{};
+  uint64_t entries[NB_TIMERS]{};
+
+  static const char *counter_names[NB_COUNTERS] = {
+    "do_move", "undo_move", "generated", "legal", "counted", "is_check",
+    "pawn_drop_is_checkmate", "tt probes", "tt hits",
+  };
+  static const char *timer_names[NB_TIMERS] = {
+    "piece moves", "drops", "legality", "count_legal",
+  };
+
+  uint64_t rdtsc() {
+    return __rdtsc();
+  }
+
+  void reset() {
+    std::memset(counters, 0, sizeof(counters));
+    std::memset(cycles, 0, sizeof(cycles));
+    std::memset(entries, 0, sizeof(entries));
+  }
+
+  void report(std::ostream& os) {
+    os << "---------------- instrumentation ----------------" << std::endl;
+    for (int c = 0; c < NB_COUNTERS; ++c) {
+      os << std::setw(24) << counter_names[c] << ": " << counters[c] << std::endl;
+    }
+    if (counters[GENERATED]) {
+      os << std::setw(24) << "legal / generated" << ": "
+         << (double)counters[LEGAL] / counters[GENERATED] << std::endl;
+    }
+    if (counters[TT_PROBE]) {
+      os << std::setw(24) << "tt hit rate" << ": "
+         << (double)counters[TT_HIT] / counters[TT_PROBE] << std::endl;
+    }
+
+    uint64_t total = 0;
+    for (int t = 0; t < NB_TIMERS; ++t) total += cycles[t];
+    for (int t = 0; t < NB_TIMERS; ++t) {
+      os << std::setw(24) << timer_names[t] << ": " << cycles[t] << " cycles";
+      if (entries[t]) os << ", " << cycles[t] / entries[t] << "/call";
+      if (total) os << ", " << std::fixed << std::setprecision(1)
+                    << 100.0 * cycles[t] / total << std::defaultfloat << "%";
+      os << std::endl;
+    }
+  }
+}
+#endif
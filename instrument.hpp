@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+/*
+Opt-in hot path instrumentation: event counters and rdtsc-based scoped timers.
+
+Build with `make INSTRUMENT=1` (after `make clean`) to enable them. Otherwise
+every macro below expands to nothing and there is no cost at all, so they can
+be left in the innermost loops. The counters are plain globals shared by all
+threads, so only single-threaded runs (perft, bench, fuzz) count exactly.
+
+  COUNT(DO_MOVE);          // bump a counter
+  COUNT_N(GENERATED, n);   // add n to a counter
+  TIME_SCOPE(DROPS);       // charge cycles until end of scope to a timer
+*/
+
+namespace Instrument {
+  enum counter {
+    DO_MOVE,
+    UNDO_MOVE,
+    GENERATED,      // pseudo-legal moves, before the check and pin masks
+    LEGAL,          // legal moves generated
+    COUNTED,        // legal moves counted by count_legal, never generated
+    IS_CHECK,
+    PAWN_DROP_MATE, // pawn_drop_is_checkmate and pawn_drop_mates calls
+    TT_PROBE,
+    TT_HIT,
+    NB_COUNTERS,
+  };
+
+  enum timer {
+    PIECE_MOVES, // piece moves, in pseudolegal() and the legal generators
+    DROPS,       // drops, likewise
+    LEGALITY,    // check and pin masks, or filtering in reference_legal()
+    COUNT_LEGAL, // count_legal, the perft leaves
+    NB_TIMERS,
+  };
+
+#ifdef INSTRUMENT
+  extern uint64_t counters[NB_COUNTERS];
+  extern uint64_t cycles[NB_TIMERS];
+  extern uint64_t entries[NB_TIMERS];
+
+  uint64_t rdtsc();
+
+  class ScopedTimer {
+    timer t;
+    uint64_t start;
+  public:
+    ScopedTimer(timer t) : t(t), start(rdtsc()) { }
+    ~ScopedTimer() {
+      cycles[t] += rdtsc() - start;
+      entries[t]++;
+    }
+  };
+
+  /// Zero all counters and timers.
+  void reset();
+  /// Print every counter and timer, with some derived ratios.
+  void report(std::ostream& os);
+#else
+  static inline void reset() { }
+  static inline void report(std::ostream&) { }
+#endif
+}
+
+#ifdef INSTRUMENT
+#define COUNT(c)      (++Instrument::counters[Instrument::c])
+#define COUNT_N(c, n) (Instrument::counters[Instrument::c] += (n))
+#define TIME_SCOPE(t) Instrument::ScopedTimer _timer_##t(Instrument::t)
+#else
+#define COUNT(c)      ((void)0)
+#define COUNT_N(c, n) ((void)0)
+#define TIME_SCOPE(t) ((void)0)
+#endif
@@ -3,11 +3,290 @@
 #include "movegen.hpp"
 #include "piece.hpp"
 #include "perft.hpp"
+#include "fuzz.hpp"
+#include "instrument.hpp"
+#include "tablebase.hpp"
+#include "packed.hpp"
+#include "fen.hpp"
+#include "selfplay.hpp"
+#include "tune.hpp"
+#include "book.hpp"
+#include "annotate.hpp"
+#include "usi.hpp"
+#include "searchbench.hpp"
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <fstream>
 #include "immintrin.h"
 
-int main() {
+/// Set up the Board from a FEN given on the command line. If it doesn't
+/// parse or can't be played from, says why and returns false.
+static bool import_arg(const std::string& fen) {
+  Board::Position pos;
+  Fen::error err = Fen::parse(fen, pos);
+  if (err != Fen::OK) {
+    std::cerr << "bad FEN " << fen << ": " << Fen::describe(err) << std::endl;
+    return false;
+  }
+  Board::set_position(pos);
+  if (!Movegen::is_playable()) {
+    std::cerr << "bad FEN " << fen << ": needs one king each, and only the "
+              << "player to move may be in check" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::string command = argc > 1 ? argv[1] : "";
+
+  // ./main fuzz [seed] [walks] [plies]
+  if (command == "fuzz") {
+    uint64_t seed  = argc > 2 ? std::stoull(argv[2]) : 1;
+    uint64_t walks = argc > 3 ? std::stoull(argv[3]) : 1000;
+    int plies      = argc > 4 ? std::stoi(argv[4]) : 100;
+    uint64_t failures = Movegen::Fuzz::fuzz(seed, walks, plies);
+    Instrument::report(std::cout);
+    return failures ? 1 : 0;
+  }
+
+  // ./main tbgen <material> <file>
+  if (command == "tbgen" && argc == 4) {
+    return Tablebase::generate(argv[2], argv[3], std::cout) ? 0 : 1;
+  }
+
+  // ./main tbprobe <file> <FEN>
+  if (command == "tbprobe" && argc == 4) {
+    Tablebase::Result result;
+    if (!Tablebase::load(argv[2])) {
+      std::cerr << "can't load " << argv[2] << std::endl;
+      return 1;
+    }
+    if (!import_arg(argv[3])) return 1;
+    if (!Tablebase::probe(result)) {
+      std::cout << "not in table" << std::endl;
+      return 1;
+    }
+    const char *wdl[] = {"loss", "draw", "win"};
+    std::cout << wdl[result.wdl + 1] << " in " << result.plies << " plies"
+              << std::endl;
+    return 0;
+  }
+
+  // ./main pack <FEN file> <packed file>
+  if (command == "pack" && argc == 4) {
+    std::ifstream in(argv[2], std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+
+    std::vector<Board::Position> positions;
+    size_t failures = Fen::parse_batch(text.str(), positions,
+                                       std::thread::hardware_concurrency());
+    Packed::Writer<Packed::Position> out(argv[3]);
+    if (!out.is_open()) {
+      std::cerr << "can't write " << argv[3] << std::endl;
+      return 1;
+    }
+    for (const Board::Position& pos : positions) {
+      Packed::Position packed;
+      Board::set_position(pos);
+      if (!Packed::encode(packed)) {
+        std::cerr << "can't pack " << Board::exportFEN() << std::endl;
+        return 1;
+      }
+      out.write(packed);
+    }
+    if (!out.close()) {
+      std::cerr << "can't write " << argv[3] << std::endl;
+      return 1;
+    }
+    std::cout << "packed " << positions.size() << " positions, "
+              << failures << " bad lines" << std::endl;
+    return 0;
+  }
+
+  // ./main fenbench <FEN file> [threads]
+  if (command == "fenbench" && argc >= 3) {
+    std::ifstream in(argv[2], std::ios::binary);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    unsigned threads = argc > 3 ? std::stoi(argv[3]) : 1;
+
+    std::vector<Board::Position> positions;
+    auto t0 = std::chrono::steady_clock::now();
+    size_t failures = Fen::parse_batch(text, positions, threads);
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::string out(positions.size() * (Fen::MAX_LENGTH + 1) + Fen::BUFFER_SIZE, 0);
+    char *p = out.data();
+    for (const Board::Position& pos : positions) {
+      p += Fen::write(pos, p);
+      *p++ = '\n';
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> parse_secs = t1 - t0, write_secs = t2 - t1;
+    std::cout << "parsed " << positions.size() << " (" << failures << " bad) on "
+              << threads << " threads: "
+              << (uint64_t)(positions.size() / parse_secs.count()) << " positions/s"
+              << std::endl;
+    std::cout << "wrote " << positions.size() << ": "
+              << (uint64_t)(positions.size() / write_secs.count()) << " positions/s"
+              << std::endl;
+    return 0;
+  }
+
+  // ./main unpack <packed file>
+  if (command == "unpack" && argc == 3) {
+    Packed::Reader<Packed::Position> in;
+    if (!in.open(argv[2])) {
+      std::cerr << "can't read " << argv[2] << std::endl;
+      return 1;
+    }
+    for (const Packed::Position& pos : in) {
+      Packed::decode(pos);
+      std::cout << Board::exportFEN() << std::endl;
+    }
+    return 0;
+  }
+
+  // ./main selfplay <file> [games] [threads] [depth] [nodes] [book]
+  if (command == "selfplay" && argc >= 3) {
+    SelfPlay::Options options;
+    options.games = argc > 3 ? std::stoull(argv[3]) : 1000;
+    options.threads = argc > 4 ? std::stoi(argv[4]) : std::thread::hardware_concurrency();
+    options.limits.depth = argc > 5 ? std::stoi(argv[5]) : 4;
+    options.limits.nodes = argc > 6 ? std::stoull(argv[6]) : 0;
+    if (argc > 7) {
+      if (!Book::load(argv[7])) {
+        std::cerr << "can't load " << argv[7] << std::endl;
+        return 1;
+      }
+      options.use_book = true;
+    }
+    SelfPlay::Stats stats = SelfPlay::run(options, argv[2], std::cout);
+    return stats.games == options.games ? 0 : 1;
+  }
+
+  // ./main tune <record file> <weights header> [epochs] [threads]
+  if (command == "tune" && argc >= 4) {
+    Tune::Options options;
+    options.epochs = argc > 4 ? std::stoi(argv[4]) : 500;
+    options.threads = argc > 5 ? std::stoi(argv[5]) : std::thread::hardware_concurrency();
+    Tune::Dataset data;
+    if (!Tune::load(argv[2], data, options.threads)) {
+      std::cerr << "can't read " << argv[2] << std::endl;
+      return 1;
+    }
+    std::vector<double> weights = Tune::current_weights();
+    auto start = std::chrono::steady_clock::now();
+    double loss = Tune::tune(data, weights, options, std::cout);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::cout << "final loss " << loss << " in " << secs.count() << "s" << std::endl;
+    if (!Tune::write_header(argv[3], weights)) {
+      std::cerr << "can't write " << argv[3] << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  // ./main book <file> [plies] [depth]
+  if (command == "book" && argc >= 3) {
+    Book::Options options;
+    options.plies = argc > 3 ? std::stoi(argv[3]) : 6;
+    options.limits.depth = argc > 4 ? std::stoi(argv[4]) : 4;
+    return Book::build(argv[2], options, std::cout) ? 0 : 1;
+  }
+
+  // ./main bookprobe <file> <FEN>
+  if (command == "bookprobe" && argc == 4) {
+    if (!Book::load(argv[2])) {
+      std::cerr << "can't load " << argv[2] << std::endl;
+      return 1;
+    }
+    if (!import_arg(argv[3])) return 1;
+    for (const Book::Entry& e : Book::entries()) {
+      std::cout << e.move << " " << e.weight << std::endl;
+    }
+    return 0;
+  }
+
+  // ./main annotate <FEN file> [multipv] [depth] [threads]
+  if (command == "annotate" && argc >= 3) {
+    std::ifstream in(argv[2], std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    Annotate::Options options;
+    options.limits.multi_pv = argc > 3 ? std::stoi(argv[3]) : 3;
+    options.limits.depth = argc > 4 ? std::stoi(argv[4]) : 4;
+    options.threads = argc > 5 ? std::stoi(argv[5]) : 1;
+
+    std::vector<Board::Position> positions;
+    Fen::parse_batch(text.str(), positions, 1);
+    std::vector<Annotate::Annotation> annotations;
+    Annotate::Stats stats = Annotate::positions(positions, annotations, options);
+    for (const Annotate::Annotation& a : annotations) Annotate::write(std::cout, a);
+    std::cerr << "annotated " << stats.positions << " positions in " << stats.seconds
+              << "s: " << stats.positions / stats.seconds << " positions/s, "
+              << (uint64_t)(stats.nodes / stats.seconds) << " nps" << std::endl;
+    return 0;
+  }
+
+  // ./main annotategame <FEN | startpos> [multipv] [depth] [moves...]
+  if (command == "annotategame" && argc >= 3) {
+    std::string fen = argv[2];
+    if (!import_arg(fen == "startpos" ? Board::startFEN : fen)) return 1;
+    Board::Position start;
+    Board::get_position(start);
+    Annotate::Options options;
+    options.limits.multi_pv = argc > 3 ? std::stoi(argv[3]) : 3;
+    options.limits.depth = argc > 4 ? std::stoi(argv[4]) : 4;
+
+    // moves are parsed by playing them out, then annotated from the start.
+    std::vector<Board::StateInfo> states(std::max(argc - 5, 0));
+    std::vector<Board::Move> moves;
+    for (int i = 5; i < argc; ++i) {
+      Board::Move m;
+      if (!Annotate::parse_move(argv[i], m)) {
+        std::cerr << "illegal move " << argv[i] << std::endl;
+        return 1;
+      }
+      Board::do_move(m, states[moves.size()]);
+      moves.push_back(m);
+    }
+
+    std::vector<Annotate::Annotation> annotations;
+    Annotate::Stats stats = Annotate::game(start, moves, annotations, options);
+    for (const Annotate::Annotation& a : annotations) Annotate::write(std::cout, a);
+    std::cerr << "annotated " << stats.positions << " positions in " << stats.seconds
+              << "s: " << stats.positions / stats.seconds << " positions/s, "
+              << (uint64_t)(stats.nodes / stats.seconds) << " nps" << std::endl;
+    return 0;
+  }
+
+  // ./main usi
+  if (command == "usi") {
+    Usi::loop(std::cin, std::cout);
+    return 0;
+  }
+
+  // ./main searchbench [depth]
+  if (command == "searchbench") {
+    Search::Bench::bench(argc > 2 ? std::stoi(argv[2]) : 7);
+    return 0;
+  }
+
+  // ./main bench
+  if (command == "bench") {
+    Instrument::reset();
+    Movegen::Perft::bench();
+    Instrument::report(std::cout);
+    return 0;
+  }
+
   std::vector<Board::Move> moves;
-  Board::StateInfo si[4];
 
   /*
   Board::importFEN(Board::startFEN);
@@ -29,18 +308,14 @@ int main() {
   // sente starts in check here
   Board::importFEN("2k1S/B1rP1/2KG1/GS1p1/R1B2 b -");
 
-  // Board::Move m(12, 16, false);
-  // Board::do_move(m, si[0]);
-  // m = Board::Move(7, 22, true);
-  // Board::do_move(m, si[1]);
-  // m = Board::Move(24, 22, false);
-  // Board::do_move(m, si[2]);
   std::cout << Board::exportFEN() << std::endl;
   Board::print_board(std::cout);
   Board::check_consistency();
 
   Movegen::allow_drop_pawn_checkmate = false;
+  Instrument::reset();
   Movegen::Perft::perft(6, true);
+  Instrument::report(std::cout);
 
   /*
   Board::importFEN("k4/5/5/5/4K b PPSSGGBBRR");
@@ -0,0 +1,54 @@
+#include "mapped.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace Mapped {
+  File::File(File&& other)
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0))
+    { }
+
+  File& File::operator=(File&& other) {
+    if (this != &other) {
+      close();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  File::~File() {
+    close();
+  }
+
+  bool File::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed.
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    data_ = static_cast<const uint8_t *>(p);
+    size_ = st.st_size;
+    return true;
+  }
+
+  void File::close() {
+    if (data_) munmap(const_cast<uint8_t *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+Read-only memory-mapped files, for data that is used in place without being
+parsed at load time (tablebases, position datasets, ...).
+*/
+
+namespace Mapped {
+  class File {
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+  public:
+    File() = default;
+    File(const File&) = delete;
+    File(File&& other);
+    File& operator=(const File&) = delete;
+    File& operator=(File&& other);
+    ~File();
+
+    /// Map the whole file. Returns false if it can't be opened or mapped.
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool is_open() const { return data_ != nullptr; }
+  };
+}
@@ -1,4 +1,6 @@
 #include "movegen.hpp"
+#include "instrument.hpp"
+#include "stack.hpp"
 #include <algorithm>
 #include <bit>
 
@@ -14,6 +16,10 @@ namespace Movegen {
   Generators for subsets of legal moves just generate the pseudo-legal
   moves, filter out the ones meeting the appropriate conditions, then
   filter out the legal ones.
+
+  That is still how reference_legal() works. The real generators (legal()
+  and friends, and count_legal()) generate legal moves directly from attack
+  bitboards and check and pin masks instead; see CheckInfo.
   */
 
   // main idea of sliding move generation from Sebastian Lague
@@ -103,10 +109,82 @@ namespace Movegen {
     return d;
   }
 
+  /* Attack bitboards, for computing legality masks without making moves. */
+
+  // squares attacked by each (colored) piece type's steps from each square.
+  // Indexed by color, piece type, then square.
+  Bitboard::bitboard step_attacks[2][Piece::NB_PIECE_TYPES][25];
+  // every square in a direction from a square, up to the edge of the board.
+  static Bitboard::bitboard rays[25][NB_DIRECTIONS];
+  // squares strictly between two squares if they share a line, else empty.
+  Bitboard::bitboard between[25][25];
+
+  int populate_attacks() {
+    for (Board::square sq = 0; sq < 25; ++sq) {
+      for (direction dir = NORTH; dir < NB_DIRECTIONS; ++dir) {
+        Bitboard::bitboard ray = 0;
+        for (int n = 1; n <= num_squares_to_edge[sq][dir]; ++n) {
+          Board::square dest = sq + direction_offsets[dir] * n;
+          between[sq][dest] = ray;
+          ray |= Bitboard::square_bb(dest);
+        }
+        rays[sq][dir] = ray;
+      }
+    }
+
+    // Board::colors may not be constructed yet.
+    for (int c = 0; c < 2; ++c) {
+      for (Piece::piece_type pt = 0; pt < Piece::NB_PIECE_TYPES; ++pt) {
+        for (Board::square sq = 0; sq < 25; ++sq) {
+          Bitboard::bitboard atk = 0;
+          for (uint8_t mask = steps_of[c][pt]; mask; mask = CLSB(mask)) {
+            direction d = (direction)std::__countr_zero(mask);
+            if (num_squares_to_edge[sq][d] == 0) continue;
+            atk |= Bitboard::square_bb(sq + direction_offsets[d]);
+          }
+          step_attacks[c][pt][sq] = atk;
+        }
+      }
+    }
+    return 0;
+  }
+  int _unused_attacks = populate_attacks();
+
+  /// Squares attacked along one direction, stopping at (and including)
+  /// the first occupied square.
+  static inline Bitboard::bitboard ray_attacks(
+    Board::square sq, direction d, Bitboard::bitboard occupied
+  ) {
+    Bitboard::bitboard ray = rays[sq][d];
+    Bitboard::bitboard blockers = ray & occupied;
+    if (!blockers) return ray;
+    // positive offsets walk towards higher squares, so the nearest blocker
+    // is the lowest one. Otherwise, it's the highest.
+    Board::square blocker = direction_offsets[d] > 0
+      ? Bitboard::lsb(blockers) : Bitboard::msb(blockers);
+    return ray ^ rays[blocker][d];
+  }
+
+  /// Squares attacked by piece p of color c standing on sq.
+  Bitboard::bitboard attacks(
+    Piece::piece p, Board::color c, Board::square sq, Bitboard::bitboard occupied
+  ) {
+    Bitboard::bitboard atk = step_attacks[c][Piece::type(p)][sq];
+    if (Piece::is_sliding_piece(p)) {
+      direction start_dir = Piece::upt(p) == Piece::BISHOP ? NORTH_EAST : NORTH;
+      direction end_dir   = Piece::upt(p) == Piece::ROOK   ? NORTH_EAST : NB_DIRECTIONS;
+      for (direction dir = start_dir; dir < end_dir; ++dir) {
+        atk |= ray_attacks(sq, dir, occupied);
+      }
+    }
+    return atk;
+  }
+
   /* Alright, now slow movegen logic. */
 
-  Board::color us;
-  Board::color them;
+  // per thread, like the Board they describe.
+  thread_local Board::color us;
+  thread_local Board::color them;
 
   void sync_colors() {
     us = Board::to_move;
@@ -190,7 +268,8 @@ namespace Movegen {
   void generate_pawn_drops(uint8_t* hand, std::vector<Board::Move>& moves) {
     // which files do we already have pawns on?
     bool file_half_closed[5]{};
-    for (Board::square sq : Board::occupancy[us]) {
+    for (Bitboard::bitboard b = Board::occupancy_bb[us]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
       if (Board::Square[sq] == Piece::color_piece(Piece::PAWN, us)) {
         file_half_closed[sq % 5] = true;
       }
@@ -229,15 +308,16 @@ namespace Movegen {
   }
 
   bool pawn_drop_is_checkmate(Board::Move m, Board::square their_king) {
-    Board::StateInfo si;
-    Board::do_move(m, si);
+    COUNT(PAWN_DROP_MATE);
+    Board::do_move(m, Stack::scratch(0).si);
     sync_colors();
     // generate our opponent's check escapes. But don't use 'check_escapes'
     // because the current implementation of it is garbage.
     // Here we just generate all the sliding/step moves, and then we will
     // only check the ones with potential: king moves and captures of the pawn.
     std::vector<Board::Move> opp_moves;
-    for (auto sq : Board::occupancy[us]) {
+    for (Bitboard::bitboard b = Board::occupancy_bb[us]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
       Piece::piece piece = Board::Square[sq];
       if (Piece::is_sliding_piece(piece)) {
         generate_sliding_moves(sq, piece, opp_moves);
@@ -270,6 +350,7 @@ namespace Movegen {
   void generate_drops(
     std::vector<Board::Move>& moves
   ) {
+    TIME_SCOPE(DROPS);
     uint8_t* hand = Board::hand[us];
     // try dropping every piece in our hand on every available square.
     // catches: cannot drop pawns in promo zone or nifu or checkmate
@@ -286,24 +367,32 @@ namespace Movegen {
     }
   }
 
-  std::vector<Board::Move> pseudolegal() {
-    std::vector<Board::Move> moves;
-    sync_colors();
-
+  void generate_piece_moves(std::vector<Board::Move>& moves) {
+    TIME_SCOPE(PIECE_MOVES);
     // iterate over our color's occupancy to find pieces
-    for (auto sq : Board::occupancy[us]) {
+    for (Bitboard::bitboard b = Board::occupancy_bb[us]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
       Piece::piece piece = Board::Square[sq];
       if (Piece::is_sliding_piece(piece)) {
         generate_sliding_moves(sq, piece, moves);
       }
       generate_step_moves(sq, piece, moves);
     }
+  }
+
+  std::vector<Board::Move> pseudolegal() {
+    std::vector<Board::Move> moves;
+    sync_colors();
+
+    generate_piece_moves(moves);
     generate_drops(moves);
+    COUNT_N(GENERATED, moves.size());
     return moves;
   }
 
   Board::square king_sq(Board::color c) {
-    for (auto sq : Board::occupancy[c]) {
+    for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
       Piece::piece p = Board::Square[sq];
       if (p == Piece::color_piece(Piece::KING, c)) {
         return sq;
@@ -317,12 +406,13 @@ namespace Movegen {
   /// Generate all of our opponent's (pseudolegal) moves, and see if any of them
   /// have our king's square as a destination.
   bool is_check(Board::square king_square) {
-    Board::StateInfo si;
+    COUNT(IS_CHECK);
     sync_colors();
 
     std::vector<Board::Move> opp_moves;
     // pseudolegal() but without the drops, which can't take our king
-    for (auto sq : Board::occupancy[Board::to_move]) {
+    for (Bitboard::bitboard b = Board::occupancy_bb[Board::to_move]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
       Piece::piece piece = Board::Square[sq];
       if (Piece::is_sliding_piece(piece)) {
         generate_sliding_moves(sq, piece, opp_moves);
@@ -342,25 +432,52 @@ namespace Movegen {
     return checked;
   }
 
-  bool is_not_legal(Board::Move m, Board::square king_square) {
-    Board::StateInfo si;
+  bool in_check() {
+    Board::color c = Board::to_move;
+    Bitboard::bitboard king = Bitboard::square_bb(king_sq(c));
+    Bitboard::bitboard occupied = Board::occupancy_bb[c] | Board::occupancy_bb[!c];
+    for (Bitboard::bitboard b = Board::occupancy_bb[!c]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
+      if (attacks(Board::Square[sq], !c, sq, occupied) & king) return true;
+    }
+    return false;
+  }
+
+  bool is_playable() {
+    for (Board::color c : Board::colors) {
+      Piece::piece king = Piece::color_piece(Piece::KING, c);
+      if (std::count(Board::Square, Board::Square + 25, king) != 1) return false;
+    }
+    // the player to move mustn't be able to take the other king.
+    Board::color c = Board::to_move;
+    Bitboard::bitboard king = Bitboard::square_bb(king_sq(!c));
+    Bitboard::bitboard occupied = Board::occupancy_bb[c] | Board::occupancy_bb[!c];
+    for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
+      if (attacks(Board::Square[sq], c, sq, occupied) & king) return false;
+    }
+    return true;
+  }
 
+  bool is_not_legal(Board::Move m, Board::square king_square) {
     // If the move moved our king, update king_square
     if (m.origin == king_square) {
       king_square = m.destination;
     }
 
-    Board::do_move(m, si);
+    // pawn_drop_is_checkmate probes with scratch frame 0 around this.
+    Board::do_move(m, Stack::scratch(1).si);
     bool result = is_check(king_square);
     Board::undo_move(m);
 
     return result;
   }
 
-  std::vector<Board::Move> legal() {
+  std::vector<Board::Move> reference_legal() {
     std::vector<Board::Move> moves = pseudolegal();
     Board::square our_king = king_sq(us);
 
+    TIME_SCOPE(LEGALITY);
     moves.erase(
       std::remove_if(
         moves.begin(), moves.end(),
@@ -368,6 +485,358 @@ namespace Movegen {
       ),
       moves.end()
     );
+    COUNT_N(LEGAL, moves.size());
+    return moves;
+  }
+
+  /* Fast legal movegen, from attack bitboards.
+
+  Everything below is templated on the color to move and, for generators,
+  on which moves to generate, so that the tables are indexed at compile
+  time and the branches on color and move type disappear. The entry points
+  at the bottom dispatch on Board::to_move once per call. */
+
+  /// Squares attacked by piece p of color C standing on sq.
+  template <Board::color C>
+  static inline Bitboard::bitboard piece_attacks(
+    Piece::piece p, Board::square sq, Bitboard::bitboard occupied
+  ) {
+    Bitboard::bitboard atk = step_attacks[C][Piece::type(p)][sq];
+    if (Piece::is_sliding_piece(p)) {
+      direction start_dir = Piece::upt(p) == Piece::BISHOP ? NORTH_EAST : NORTH;
+      direction end_dir   = Piece::upt(p) == Piece::ROOK   ? NORTH_EAST : NB_DIRECTIONS;
+      for (direction dir = start_dir; dir < end_dir; ++dir) {
+        atk |= ray_attacks(sq, dir, occupied);
+      }
+    }
+    return atk;
+  }
+
+  /// Everything needed to decide legality without making moves.
+  struct CheckInfo {
+    Board::square ksq;
+    Bitboard::bitboard danger;   // squares they attack, seen through our king
+    Bitboard::bitboard checkers;
+    Bitboard::bitboard pinned;
+    // Non-king moves must land here: everywhere if not in check, capturing
+    // or blocking a lone checker, and nowhere in double check.
+    Bitboard::bitboard evasion;
+    Bitboard::bitboard pin_ray[25]; // only valid for pinned squares
+  };
+
+  template <Board::color Us>
+  static void compute_check_info(CheckInfo& ci) {
+    using namespace Bitboard;
+    constexpr Board::color Them = !Us;
+    bitboard ours = Board::occupancy_bb[Us];
+    bitboard occupied = ours | Board::occupancy_bb[Them];
+    ci.ksq = king_sq(Us);
+    bitboard king = square_bb(ci.ksq);
+
+    // One pass over their pieces finds the squares they attack, which pieces
+    // give check, and which of our pieces are pinned. Attacks are computed
+    // through our king so that it can't step back along a slider's line.
+    ci.danger = ci.checkers = ci.pinned = 0;
+    for (bitboard b = Board::occupancy_bb[Them]; b; ) {
+      Board::square sq = pop_lsb(b);
+      Piece::piece p = Board::Square[sq];
+      bitboard atk = piece_attacks<Them>(p, sq, occupied ^ king);
+      ci.danger |= atk;
+
+      if (atk & king) {
+        ci.checkers |= square_bb(sq);
+      } else if (Piece::is_sliding_piece(p) && (piece_attacks<Them>(p, sq, 0) & king)) {
+        // the slider is lined up with our king. If exactly one piece is in
+        // the way and it's ours, that piece is pinned.
+        bitboard blockers = between[ci.ksq][sq] & occupied;
+        if (blockers && !more_than_one(blockers) && (blockers & ours)) {
+          ci.pinned |= blockers;
+          ci.pin_ray[lsb(blockers)] = between[ci.ksq][sq] | square_bb(sq);
+        }
+      }
+    }
+
+    if (!ci.checkers) {
+      ci.evasion = ALL;
+    } else if (more_than_one(ci.checkers)) {
+      ci.evasion = 0;
+    } else {
+      ci.evasion = between[ci.ksq][lsb(ci.checkers)] | ci.checkers;
+    }
+  }
+
+  /// Files on which color C has an unpromoted pawn.
+  template <Board::color C>
+  static Bitboard::bitboard pawn_files() {
+    Bitboard::bitboard files = 0;
+    constexpr Piece::piece pawn = (C == Board::SENTE ? Piece::SENTE : Piece::GOTE) | Piece::PAWN;
+    for (Bitboard::bitboard b = Board::occupancy_bb[C]; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
+      if (Board::Square[sq] == pawn) files |= Bitboard::file_bb(sq % 5);
+    }
+    return files;
+  }
+
+  /// Would dropping a pawn on sq, checking their king, be checkmate?
+  /// Decided from attack bitboards without making the drop or generating
+  /// any of their moves. The pawn is adjacent to their king, so the check
+  /// can't be blocked: they escape only if their king has a flight square
+  /// we don't cover (which includes taking an undefended pawn), or some
+  /// unpinned piece can take the pawn.
+  template <Board::color Us>
+  static bool pawn_drop_mates(Board::square sq, Board::square their_king) {
+    using namespace Bitboard;
+    constexpr Board::color Them = !Us;
+    COUNT(PAWN_DROP_MATE);
+    bitboard theirs = Board::occupancy_bb[Them];
+    bitboard king = square_bb(their_king);
+    bitboard occupied = Board::occupancy_bb[Us] | theirs | square_bb(sq);
+
+    // what we cover with the pawn down, looking through their king, and
+    // which of their pieces we pin.
+    bitboard covered = 0, pinned = 0;
+    for (bitboard b = Board::occupancy_bb[Us]; b; ) {
+      Board::square s = pop_lsb(b);
+      Piece::piece p = Board::Square[s];
+      covered |= piece_attacks<Us>(p, s, occupied ^ king);
+
+      if (Piece::is_sliding_piece(p) && (piece_attacks<Us>(p, s, 0) & king)) {
+        bitboard blockers = between[their_king][s] & occupied;
+        if (blockers && !more_than_one(blockers) && (blockers & theirs)) {
+          pinned |= blockers;
+        }
+      }
+    }
+
+    if (step_attacks[Them][Piece::KING][their_king] & ~theirs & ~covered) {
+      return false;
+    }
+
+    // a pinned piece can't take the pawn: it sits right next to the king,
+    // so it is never on a pin ray.
+    for (bitboard b = theirs & ~king & ~pinned; b; ) {
+      Board::square s = pop_lsb(b);
+      if (piece_attacks<Them>(Board::Square[s], s, occupied) & square_bb(sq)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Where may we drop a pawn? Empty evasion squares, minus nifu files and
+  /// our last rank, and minus the square that would be drop pawn checkmate.
+  template <Board::color Us>
+  static Bitboard::bitboard pawn_drop_targets(Bitboard::bitboard drop_targets) {
+    using namespace Bitboard;
+    constexpr Board::color Them = !Us;
+    bitboard targets = drop_targets & ~pawn_files<Us>() & ~promo_zone(Us);
+
+    if (!allow_drop_pawn_checkmate) {
+      // the only drop that checks is where an enemy pawn on their king
+      // would attack.
+      Board::square their_king = king_sq(Them);
+      bitboard check_sq = step_attacks[Them][Piece::PAWN][their_king] & targets;
+      if (check_sq) {
+        if (pawn_drop_mates<Us>(lsb(check_sq), their_king)) targets ^= check_sq;
+      }
+    }
+    return targets;
+  }
+
+  /// Generate legal drops from masks. A drop can never expose our king, so
+  /// restricting the targets to the evasion squares is enough for legality.
+  /// All hand pieces are batched: the piece list is built once, then every
+  /// target square gets one move per piece.
+  template <Board::color Us>
+  static void generate_legal_drops(const CheckInfo& ci, std::vector<Board::Move>& moves) {
+    using namespace Bitboard;
+    constexpr Piece::piece color_bit = Us == Board::SENTE ? Piece::SENTE : Piece::GOTE;
+    TIME_SCOPE(DROPS);
+    const uint8_t *hand = Board::hand[Us];
+
+    Piece::piece pieces[Piece::NB_UNPROMOTED];
+    unsigned nb_pieces = 0;
+    for (Piece::piece_type pt = Piece::SILVER; pt < Piece::NB_UNPROMOTED; ++pt) {
+      if (hand[pt]) pieces[nb_pieces++] = color_bit | pt;
+    }
+
+    bitboard empty = ALL & ~(Board::occupancy_bb[Us] | Board::occupancy_bb[!Us]);
+    COUNT_N(GENERATED, nb_pieces * popcount(empty) + (hand[Piece::PAWN]
+      ? popcount(empty & ~pawn_files<Us>() & ~promo_zone(Us)) : 0));
+    bitboard targets = empty & ci.evasion;
+    bitboard pawn_targets = hand[Piece::PAWN] ? pawn_drop_targets<Us>(targets) : 0;
+
+    moves.reserve(moves.size() + nb_pieces * popcount(targets) + popcount(pawn_targets));
+    while (pawn_targets) {
+      moves.push_back(Board::Move(pop_lsb(pawn_targets), color_bit | Piece::PAWN));
+    }
+    if (nb_pieces == 0) return;
+    while (targets) {
+      Board::square sq = pop_lsb(targets);
+      for (unsigned i = 0; i < nb_pieces; ++i) {
+        moves.push_back(Board::Move(sq, pieces[i]));
+      }
+    }
+  }
+
+  /// Add a move from sq to each of dests, with promotions. Pawns promote
+  /// whenever they can; other promotable pieces have a choice.
+  template <Board::color Us>
+  static inline void add_piece_moves(
+    Board::square sq, Piece::piece p, Bitboard::bitboard dests,
+    std::vector<Board::Move>& moves
+  ) {
+    using namespace Bitboard;
+    constexpr bitboard zone = promo_zone(Us);
+    if (Piece::type(p) == Piece::PAWN) {
+      while (dests) {
+        Board::square dest = pop_lsb(dests);
+        moves.push_back(Board::Move(sq, dest, (square_bb(dest) & zone) != 0));
+      }
+    } else if (Piece::can_promote(p)) {
+      bitboard promotions = (square_bb(sq) & zone) ? dests : dests & zone;
+      while (dests) {
+        Board::square dest = pop_lsb(dests);
+        moves.push_back(Board::Move(sq, dest, false));
+        if (promotions & square_bb(dest)) moves.push_back(Board::Move(sq, dest, true));
+      }
+    } else {
+      while (dests) moves.push_back(Board::Move(sq, pop_lsb(dests), false));
+    }
+  }
+
+  /// How many moves add_piece_moves would add for these destinations.
+  template <Board::color Us>
+  static inline size_t nb_piece_moves(
+    Board::square sq, Piece::piece p, Bitboard::bitboard dests
+  ) {
+    using namespace Bitboard;
+    constexpr bitboard zone = promo_zone(Us);
+    size_t n = popcount(dests);
+    // pawns promote whenever they can, but other promotable pieces have
+    // a choice, so each promoting destination is a second move.
+    if (Piece::can_promote(p) && Piece::type(p) != Piece::PAWN) {
+      n += popcount((square_bb(sq) & zone) ? dests : dests & zone);
+    }
+    return n;
+  }
+
+  /// Generate legal moves of pieces on the board. Every destination is
+  /// checked against the check and pin masks, so nothing is made.
+  template <Board::color Us, GenType Type>
+  static void generate_legal_piece_moves(const CheckInfo& ci, std::vector<Board::Move>& moves) {
+    using namespace Bitboard;
+    TIME_SCOPE(PIECE_MOVES);
+    bitboard ours = Board::occupancy_bb[Us];
+    bitboard theirs = Board::occupancy_bb[!Us];
+    bitboard target = Type == CAPTURES ? theirs
+                    : Type == QUIETS   ? ALL & ~(ours | theirs)
+                    :                    ALL & ~ours;
+
+    constexpr Piece::piece king = (Us == Board::SENTE ? Piece::SENTE : Piece::GOTE) | Piece::KING;
+    bitboard king_dests = step_attacks[Us][Piece::KING][ci.ksq] & target;
+    COUNT_N(GENERATED, popcount(king_dests));
+    add_piece_moves<Us>(ci.ksq, king, king_dests & ~ci.danger, moves);
+    // in double check, only the king can move.
+    if (!ci.evasion) return;
+
+    for (bitboard b = ours ^ square_bb(ci.ksq); b; ) {
+      Board::square sq = pop_lsb(b);
+      Piece::piece p = Board::Square[sq];
+      bitboard dests = piece_attacks<Us>(p, sq, ours | theirs) & target;
+      COUNT_N(GENERATED, nb_piece_moves<Us>(sq, p, dests));
+      dests &= ci.evasion;
+      if (ci.pinned & square_bb(sq)) dests &= ci.pin_ray[sq];
+      add_piece_moves<Us>(sq, p, dests, moves);
+    }
+  }
+
+  template <Board::color Us, GenType Type>
+  static void generate(std::vector<Board::Move>& moves) {
+    CheckInfo ci;
+    {
+      TIME_SCOPE(LEGALITY);
+      compute_check_info<Us>(ci);
+    }
+    if constexpr (Type != DROPS) generate_legal_piece_moves<Us, Type>(ci, moves);
+    if constexpr (Type == DROPS || Type == EVASIONS || Type == LEGAL) {
+      generate_legal_drops<Us>(ci, moves);
+    }
+  }
+
+  template <GenType Type>
+  void generate(std::vector<Board::Move>& moves) {
+    moves.clear();
+    if (Board::to_move == Board::SENTE) {
+      generate<Board::SENTE, Type>(moves);
+    } else {
+      generate<Board::GOTE, Type>(moves);
+    }
+    COUNT_N(LEGAL, moves.size());
+  }
+  template void generate<CAPTURES>(std::vector<Board::Move>&);
+  template void generate<QUIETS>(std::vector<Board::Move>&);
+  template void generate<DROPS>(std::vector<Board::Move>&);
+  template void generate<EVASIONS>(std::vector<Board::Move>&);
+  template void generate<LEGAL>(std::vector<Board::Move>&);
+
+  template <GenType Type>
+  std::vector<Board::Move> generate() {
+    std::vector<Board::Move> moves;
+    generate<Type>(moves);
     return moves;
   }
+  template std::vector<Board::Move> generate<CAPTURES>();
+  template std::vector<Board::Move> generate<QUIETS>();
+  template std::vector<Board::Move> generate<DROPS>();
+  template std::vector<Board::Move> generate<EVASIONS>();
+  template std::vector<Board::Move> generate<LEGAL>();
+
+  std::vector<Board::Move> legal()         { return generate<LEGAL>(); }
+  std::vector<Board::Move> captures()      { return generate<CAPTURES>(); }
+  std::vector<Board::Move> quiet()         { return generate<QUIETS>(); }
+  std::vector<Board::Move> drops()         { return generate<DROPS>(); }
+  std::vector<Board::Move> check_escapes() { return generate<EVASIONS>(); }
+
+  template <Board::color Us>
+  static size_t count_legal() {
+    using namespace Bitboard;
+    TIME_SCOPE(COUNT_LEGAL);
+    CheckInfo ci;
+    compute_check_info<Us>(ci);
+    bitboard ours = Board::occupancy_bb[Us];
+    bitboard occupied = ours | Board::occupancy_bb[!Us];
+    bitboard king = square_bb(ci.ksq);
+
+    size_t count = popcount(step_attacks[Us][Piece::KING][ci.ksq] & ~ours & ~ci.danger);
+    // in double check, only the king can move.
+    if (!ci.evasion) return count;
+
+    for (bitboard b = ours ^ king; b; ) {
+      Board::square sq = pop_lsb(b);
+      Piece::piece p = Board::Square[sq];
+
+      bitboard dests = piece_attacks<Us>(p, sq, occupied) & ~ours & ci.evasion;
+      if (ci.pinned & square_bb(sq)) dests &= ci.pin_ray[sq];
+      count += nb_piece_moves<Us>(sq, p, dests);
+    }
+
+    // drops can go on any empty square that resolves a check, if in check.
+    bitboard drop_targets = ALL & ~occupied & ci.evasion;
+    for (Piece::piece_type pt = Piece::SILVER; pt < Piece::NB_UNPROMOTED; ++pt) {
+      if (Board::hand[Us][pt]) count += popcount(drop_targets);
+    }
+    if (Board::hand[Us][Piece::PAWN]) {
+      count += popcount(pawn_drop_targets<Us>(drop_targets));
+    }
+
+    return count;
+  }
+
+  size_t count_legal() {
+    size_t count = Board::to_move == Board::SENTE
+      ? count_legal<Board::SENTE>() : count_legal<Board::GOTE>();
+    COUNT_N(COUNTED, count);
+    return count;
+  }
 }
@@ -5,22 +5,64 @@
 #include <vector>
 
 namespace Movegen {
+  /// Which legal moves a generator produces. CAPTURES, QUIETS and DROPS
+  /// partition LEGAL. EVASIONS is meant for positions in check, where it
+  /// is the same as LEGAL; it is LEGAL outside check too.
+  enum GenType {
+    CAPTURES, // piece moves that capture, promoting or not
+    QUIETS,   // piece moves that don't capture, promoting or not
+    DROPS,
+    EVASIONS,
+    LEGAL,
+  };
+  /// Generate the legal moves of the given type. Specialized at compile
+  /// time on the type and the player to move.
+  template <GenType Type>
+  std::vector<Board::Move> generate();
+  /// The same into moves, which is cleared first. Reusing one vector (like
+  /// a search stack frame's) saves allocating a new one every time.
+  template <GenType Type>
+  void generate(std::vector<Board::Move>& moves);
+
   /// Generate all pseudo-legal moves.
   std::vector<Board::Move> pseudolegal();
   /// Generate all legal moves.
   std::vector<Board::Move> legal();
+  /// Generate all legal moves by making every pseudo-legal move and testing
+  /// for check. Slow, but obviously correct: this is the reference that any
+  /// faster generator is fuzzed against (see fuzz.hpp). Don't optimize it!
+  std::vector<Board::Move> reference_legal();
+  /// Count the legal moves without generating or making any of them, using
+  /// check and pin masks. Always equal to legal().size().
+  size_t count_legal();
   /// Generate all legal drops.
   std::vector<Board::Move> drops();
   /// Generate all potential checks.
   std::vector<Board::Move> checks();
-  /// Generate all potential captures.
+  /// Generate all legal captures.
   std::vector<Board::Move> captures();
-  /// Generate "quiet" moves - not captures or
-  /// promotions. Include checks?
+  /// Generate legal "quiet" moves: piece moves that don't capture. Drops
+  /// aren't included, and checks and promotions are.
   std::vector<Board::Move> quiet();
-  /// Generate escapes from checks
-  /// (what will this do if position is not check?)
+  /// Generate escapes from checks. Outside check this is all legal moves.
   std::vector<Board::Move> check_escapes();
 
+  /// Squares attacked by piece p of color c standing on sq, given the
+  /// occupied squares.
+  Bitboard::bitboard attacks(
+    Piece::piece p, Board::color c, Board::square sq, Bitboard::bitboard occupied
+  );
+  /// Find the king of the given color. Throws if there isn't one.
+  Board::square king_sq(Board::color c);
+  /// Does the player to move attack the given square? Called after a move
+  /// has been made to see if it left the mover's king in check.
+  bool is_check(Board::square king_square);
+  /// Is the player to move in check?
+  bool in_check();
+  /// Can play go on from the Board? Each side needs exactly one king, and
+  /// the player not to move mustn't be in check. Everything that takes
+  /// positions from outside (FENs, USI) should check this before moving.
+  bool is_playable();
+
   extern bool allow_drop_pawn_checkmate;
 }
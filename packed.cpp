@@ -0,0 +1,67 @@
+#include "packed.hpp"
+
+namespace Packed {
+  typedef unsigned __int128 uint128;
+
+  static constexpr unsigned STM_BIT    = 25;
+  static constexpr unsigned HAND_SHIFT = 26;
+  static constexpr unsigned HAND_BITS  = 2;
+  static constexpr unsigned PIECE_SHIFT = 46;
+  static constexpr unsigned PIECE_BITS  = 5;
+  static constexpr int MAX_PIECES       = (128 - PIECE_SHIFT) / PIECE_BITS;
+
+  bool encode(Position& out) {
+    Bitboard::bitboard occupied = Board::occupancy_bb[Board::SENTE]
+                                | Board::occupancy_bb[Board::GOTE];
+    if (Bitboard::popcount(occupied) > MAX_PIECES) return false;
+
+    uint128 bits = occupied;
+    bits |= (uint128)Board::to_move << STM_BIT;
+
+    unsigned shift = HAND_SHIFT;
+    for (Board::color c : Board::colors) {
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        if (Board::hand[c][pt] > 3) return false;
+        bits |= (uint128)Board::hand[c][pt] << shift;
+        shift += HAND_BITS;
+      }
+    }
+
+    shift = PIECE_SHIFT;
+    for (Bitboard::bitboard b = occupied; b; ) {
+      Piece::piece p = Board::Square[Bitboard::pop_lsb(b)];
+      unsigned code = Piece::type(p) | (Piece::color(p) << 4);
+      bits |= (uint128)code << shift;
+      shift += PIECE_BITS;
+    }
+
+    std::memcpy(out.bytes, &bits, sizeof(out.bytes));
+    return true;
+  }
+
+  void decode(const Position& in) {
+    uint128 bits;
+    std::memcpy(&bits, in.bytes, sizeof(bits));
+
+    Board::clear();
+    Board::to_move = (bits >> STM_BIT) & 1;
+
+    unsigned shift = HAND_SHIFT;
+    for (Board::color c : Board::colors) {
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        Board::hand[c][pt] = (bits >> shift) & 3;
+        shift += HAND_BITS;
+      }
+    }
+
+    shift = PIECE_SHIFT;
+    for (Bitboard::bitboard b = bits & Bitboard::ALL; b; ) {
+      Board::square sq = Bitboard::pop_lsb(b);
+      unsigned code = (bits >> shift) & 0x1F;
+      shift += PIECE_BITS;
+      Board::occupy(sq, Piece::color_piece(code & Piece::PIECE_TYPE_MASK, code >> 4));
+    }
+    Board::key = Board::compute_key();
+    Board::st = NULL;
+  }
+}
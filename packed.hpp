@@ -0,0 +1,134 @@
+#pragma once
+
+#include "board.hpp"
+#include "mapped.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+Compact binary positions, for storing the very large position sets used for
+training and analysis, and streaming files of them.
+
+A Packed::Position is 16 bytes, read as a little-endian 128-bit integer:
+  bits  0-24  occupied squares
+  bit   25    player to move
+  bits 26-45  hand counts, 2 bits per piece type, sente's PSGBR then gote's
+  bits 46-    5 bits per occupied square in ascending order: the piece type
+              (with its promoted bit), then 1 for gote
+Up to 16 pieces fit on the board, which is more than minishogi has.
+
+Files are a 16 byte header followed by fixed-size records, so they can be
+memory-mapped and iterated in place. The header's magic says what kind of
+records follow; files of packed positions use MAGIC, and other record types
+with the same size should pass their own.
+*/
+
+namespace Packed {
+  struct Position {
+    uint8_t bytes[16];
+  };
+  static_assert(sizeof(Position) == 16, "Position must stay 16 bytes");
+
+  /// Pack the current Board position. Returns false if it doesn't fit
+  /// (more than 16 pieces on the board or 3 of a piece type in hand).
+  bool encode(Position& out);
+  /// Set up the Board from a packed position.
+  void decode(const Position& in);
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t unused;
+  };
+  static_assert(sizeof(FileHeader) == 16, "header must keep records aligned");
+  static const char MAGIC[8] = {'T', 'S', 'H', 'O', 'P', 'K', '0', '1'};
+
+  /// Buffered writer of fixed-size records T (Position, or anything else
+  /// trivially copyable).
+  template <typename T>
+  class Writer {
+    static_assert(std::is_trivially_copyable<T>::value, "records are written raw");
+
+    FILE *file = nullptr;
+    std::vector<T> buffer;
+    size_t used = 0;
+    bool failed = false;
+
+  public:
+    explicit Writer(const std::string& path, const char (&magic)[8] = MAGIC,
+                    size_t buffer_records = 1 << 16)
+      : buffer(buffer_records)
+    {
+      file = std::fopen(path.c_str(), "wb");
+      if (!file) return;
+      FileHeader header{};
+      std::memcpy(header.magic, magic, sizeof(header.magic));
+      header.record_size = sizeof(T);
+      failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+    }
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    ~Writer() { close(); }
+
+    bool is_open() const { return file != nullptr; }
+
+    void write(const T& record) {
+      buffer[used++] = record;
+      if (used == buffer.size()) flush();
+    }
+
+    void flush() {
+      if (file && used && std::fwrite(buffer.data(), sizeof(T), used, file) != used) {
+        failed = true;
+      }
+      used = 0;
+    }
+
+    /// Flush and close. Returns false if the file never opened or any
+    /// write failed, in which case the file can't be trusted.
+    bool close() {
+      if (!file) return false;
+      flush();
+      if (std::fclose(file) != 0) failed = true;
+      file = nullptr;
+      return !failed;
+    }
+  };
+
+  /// Memory-mapped view of a file of records. Nothing is copied: records
+  /// are read straight out of the mapping.
+  template <typename T>
+  class Reader {
+    static_assert(std::is_trivially_copyable<T>::value, "records are read raw");
+
+    Mapped::File file;
+    const T *records = nullptr;
+    size_t count = 0;
+
+  public:
+    /// Returns false if the file can't be mapped or doesn't hold T records
+    /// under this magic.
+    bool open(const std::string& path, const char (&magic)[8] = MAGIC) {
+      if (!file.open(path) || file.size() < sizeof(FileHeader)) return false;
+      FileHeader header;
+      std::memcpy(&header, file.data(), sizeof(header));
+      if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0
+          || header.record_size != sizeof(T)
+          || (file.size() - sizeof(FileHeader)) % sizeof(T) != 0) {
+        file.close();
+        return false;
+      }
+      records = reinterpret_cast<const T *>(file.data() + sizeof(FileHeader));
+      count = (file.size() - sizeof(FileHeader)) / sizeof(T);
+      return true;
+    }
+
+    size_t size() const { return count; }
+    const T& operator[](size_t i) const { return records[i]; }
+    const T *begin() const { return records; }
+    const T *end() const { return records + count; }
+  };
+}
@@ -1,15 +1,23 @@
 #pragma once
 
 #include "movegen.hpp"
+#include "stack.hpp"
+#include <chrono>
+#include <utility>
 
 /* Header-only perft engine for testing movegen. */
 
 namespace Movegen {
 namespace Perft {
 
-uint64_t perft(int depth, bool display = false) {
-  std::vector<Board::Move> moves;
+/// Count the leaves [depth] plies down. CopyMake chooses how moves are
+/// taken back (see Board::make). Each ply makes its moves into its own
+/// search stack frame, starting from ss (this thread's first frame if not
+/// given).
+template <bool CopyMake = Board::COPY_MAKE_DEFAULT>
+uint64_t perft(int depth, bool display = false, Stack::Frame *ss = nullptr) {
   uint64_t nodes = 0;
+  if (!ss) ss = Stack::frames();
 
   if (display) {
     std::cout << "perft(" << depth << ") for position " << Board::exportFEN() << std::endl;
@@ -17,24 +25,18 @@ uint64_t perft(int depth, bool display = false) {
   }
 
   if (depth == 0) return 1;
-  moves = legal();
+  // bulk-count the leaves: we don't need to know what the moves are.
   if (depth == 1 && !display) {
-    return moves.size();
+    return count_legal();
   }
+  std::vector<Board::Move>& moves = ss->moves;
+  generate<LEGAL>(moves);
 
   for (int i = 0; i < moves.size(); ++i) {
-    // note that 'legal' has already do_move'd every move in the vector
-    // as part of checking if it was legal. So we're repeating work here!
-    // This inherent slowdown is easy to fix once we are using a proper
-    // legal move generator (i.e. doesn't try to move pinned pieces).
-    // Checkmate-pawndrops will probably always be detected by making the
-    // move and testing if it is checkmate in whatever way becomes normal -
-    // this can happen at most once per node so isn't particularly hot.
-    Board::StateInfo si;
-    Board::do_move(moves[i], si);
-    uint64_t here = perft(depth - 1, false);
+    ss->make<CopyMake>(moves[i]);
+    uint64_t here = perft<CopyMake>(depth - 1, false, ss + 1);
     nodes += here;
-    Board::undo_move(moves[i]);
+    ss->unmake<CopyMake>(moves[i]);
 
     if (display) {
       std::cout << moves[i] << ": " << here << std::endl;
@@ -49,5 +51,41 @@ print_results:
   return nodes;
 }
 
+/// A few positions with different characters, and the perft depth for each.
+static const std::pair<const char *, int> bench_positions[] = {
+  { "rbsgk/4p/5/P4/KGSBR b -",       6 }, // startFEN
+  { "2k1S/B1rP1/2KG1/GS1p1/R1B2 b -", 6 }, // sente starts in check
+  { "k2TS/2G2/BS3/b2K1/R4 b PRg",    4 }, // potential drop pawn checkmate
+  { "k3S/B1GP1/5/GS1K1/R1B2 b RP",   5 }, // drop heavy
+};
+
+/// Run perft over the bench positions and report nodes per second.
+template <bool CopyMake>
+uint64_t bench_mode(const char *name) {
+  uint64_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto [fen, depth] : bench_positions) {
+    Board::importFEN(fen);
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t nodes = perft<CopyMake>(depth);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - t0;
+    total += nodes;
+    std::cout << fen << " perft(" << depth << ") = " << nodes << " ("
+              << (uint64_t)(nodes / secs.count()) << " nps)" << std::endl;
+  }
+
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << "bench (" << name << "): " << total << " nodes in " << secs.count()
+            << "s, " << (uint64_t)(total / secs.count()) << " nps" << std::endl;
+  return total;
+}
+
+/// Bench both ways of taking moves back.
+uint64_t bench() {
+  uint64_t total = bench_mode<false>("make/unmake");
+  return total + bench_mode<true>("copy-make");
+}
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,481 @@
+#include "search.hpp"
+#include "movegen.hpp"
+#include "instrument.hpp"
+#include "tablebase.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Search {
+  enum bound : uint8_t { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+  struct TTEntry {
+    uint32_t key32;   // upper half of the key; the lower half is the index
+    Board::Move move;
+    int16_t score;
+    int8_t depth;
+    bound flag;
+  };
+  static_assert(sizeof(TTEntry) == 12, "TTEntry should stay small");
+
+  static constexpr unsigned DEFAULT_HASH_BITS = 16;
+
+  static thread_local std::vector<TTEntry> tt;
+  static thread_local uint64_t tt_mask;
+
+  // killers and static evals are kept per ply in the search stack.
+  // history is indexed by the moving (or dropped) piece, then destination
+  static thread_local int history[Piece::GOTE | Piece::NB_PIECE_TYPES][25];
+
+  static thread_local uint64_t nodes;
+  static thread_local uint64_t node_limit;
+  static thread_local Control *control;
+  static thread_local Selectivity selectivity;
+  static thread_local int root_depth;
+  static thread_local bool stopped;
+  static thread_local Board::Move root_best;
+  // multi-PV: root moves already found at this depth, not to be searched.
+  static thread_local std::vector<Board::Move> root_excluded;
+
+  void set_hash_bits(unsigned bits) {
+    tt.assign(size_t(1) << bits, TTEntry{});
+    tt_mask = tt.size() - 1;
+  }
+
+  void clear() {
+    if (tt.empty()) {
+      set_hash_bits(DEFAULT_HASH_BITS);
+    } else {
+      std::fill(tt.begin(), tt.end(), TTEntry{});
+    }
+    Stack::Frame *ss = Stack::frames();
+    for (int ply = 0; ply < MAX_PLY; ++ply) {
+      ss[ply].killers[0] = ss[ply].killers[1] = Board::Move();
+    }
+    std::memset(history, 0, sizeof(history));
+  }
+
+  /// Mate scores are stored relative to the node rather than the root, so
+  /// that they stay right when the entry is found at another ply.
+  static inline value value_to_tt(value v, int ply) {
+    return v >= VALUE_MATE_IN_MAX_PLY ? v + ply : v <= -VALUE_MATE_IN_MAX_PLY ? v - ply : v;
+  }
+  static inline value value_from_tt(value v, int ply) {
+    return v >= VALUE_MATE_IN_MAX_PLY ? v - ply : v <= -VALUE_MATE_IN_MAX_PLY ? v + ply : v;
+  }
+
+  int repetitions(int max_count, Board::color& loser) {
+    int count = 0;
+    // has every move since the current position been a check, by us / them?
+    bool we_check = true, they_check = true;
+    int ply = 0;
+    for (const Board::StateInfo *s = Board::st; s && count < max_count; s = s->prev, ++ply) {
+      // positions repeat at the earliest 4 plies apart, with the same player to move.
+      if (ply >= 4 && ply % 2 == 0 && s->key == Board::key && count++ == 0) {
+        loser = we_check ? Board::to_move : they_check ? !Board::to_move : Board::SENTE;
+      }
+      // on odd plies they are to move, so a check there was given by us.
+      if (ply % 2) we_check &= s->in_check; else they_check &= s->in_check;
+      // positions before a pass aren't on the same line of play.
+      if (s->null_move) break;
+    }
+    return count;
+  }
+
+  int64_t now() {
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t).count();
+  }
+
+  /// Is the search out of nodes or time, or told to stop? The first
+  /// iteration always runs to the end.
+  static inline bool out_of_budget() {
+    if (root_depth == 1) return false;
+    if (node_limit && nodes >= node_limit) stopped = true;
+    if (control && (nodes & 4095) == 0) {
+      int64_t deadline = control->deadline.load(std::memory_order_relaxed);
+      if (control->stop.load(std::memory_order_relaxed) || (deadline && now() >= deadline)) {
+        stopped = true;
+      }
+    }
+    return stopped;
+  }
+
+  static inline bool is_capture(const Board::Move& m) {
+    return m.pieceDrop == Piece::NO_PIECE && Board::Square[m.destination] != Piece::NO_PIECE;
+  }
+
+  static inline Piece::piece moved_piece(const Board::Move& m) {
+    return m.pieceDrop != Piece::NO_PIECE ? m.pieceDrop : Board::Square[m.origin];
+  }
+
+  // A repetition decides the game (sennichite), but only by the path to
+  // it: the same position reached another way may be anything. So it is
+  // scored below every mate score, and the table and the mate cutoff in
+  // search() never take it for a mate. Repeating sooner is still better.
+  static constexpr value VALUE_REPETITION = VALUE_MATE_IN_MAX_PLY - 1 - MAX_PLY;
+
+  // margins by depth, in centipawns.
+  static constexpr value FUTILITY_MARGIN[3] = {0, 250, 500};
+  static constexpr value RAZOR_MARGIN[3] = {0, 400, 700};
+  // razoring's margin grows by this for each kind of piece the player to
+  // move holds, since qsearch doesn't try drops.
+  static constexpr value RAZOR_DROP_MARGIN = 150;
+
+  /// A tablebase result as a score: mates as usual, counted from the root,
+  /// except that mates beyond MAX_PLY are scored as big wins instead, since
+  /// mate scores can't say that far.
+  static inline value tablebase_value(const Tablebase::Result& tb, int ply) {
+    if (tb.wdl == 0) return 0;
+    int mate_ply = ply + tb.plies;
+    value v = mate_ply < MAX_PLY ? VALUE_MATE - mate_ply : VALUE_MATE_IN_MAX_PLY - 1;
+    return tb.wdl > 0 ? v : -v;
+  }
+
+  /// Is the drop m next to the enemy king? Those threaten mate too often to
+  /// be pruned or reduced like other quiet moves.
+  static inline bool drop_near(const Board::Move& m, Board::square king) {
+    if (m.pieceDrop == Piece::NO_PIECE) return false;
+    int file_distance = std::abs(m.destination % 5 - king % 5);
+    int rank_distance = std::abs(m.destination / 5 - king / 5);
+    return std::max(file_distance, rank_distance) <= 1;
+  }
+
+  /// Could the player to move be in zugzwang? Then a pass would be better
+  /// than any move and null-move pruning would go wrong. With something in
+  /// hand there is always a drop; with only the king and pawns there may be
+  /// nothing useful to do.
+  static bool zugzwang_risk(Board::color c) {
+    for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+      if (Board::hand[c][pt]) return false;
+    }
+    for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+      Piece::piece_type pt = Piece::type(Board::Square[Bitboard::pop_lsb(b)]);
+      if (pt != Piece::KING && pt != Piece::PAWN) return false;
+    }
+    return true;
+  }
+
+  /// How many kinds of piece c holds.
+  static int hand_kinds(Board::color c) {
+    int kinds = 0;
+    for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+      kinds += Board::hand[c][pt] != 0;
+    }
+    return kinds;
+  }
+
+  /// Order moves: the TT move, then captures by most valuable victim and
+  /// least valuable attacker, then killers, then the rest by history.
+  static void score_moves(Stack::Frame *ss, const Board::Move& tt_move) {
+    const std::vector<Board::Move>& moves = ss->moves;
+    ss->scores.resize(moves.size());
+    int *scores = ss->scores.data();
+    for (size_t i = 0; i < moves.size(); ++i) {
+      const Board::Move& m = moves[i];
+      int score;
+      if (m == tt_move) {
+        score = 1 << 30;
+      } else if (is_capture(m)) {
+        score = (1 << 24)
+              + Eval::piece_value[Piece::type(Board::Square[m.destination])] * 16
+              - Piece::type(Board::Square[m.origin]);
+      } else if (m == ss->killers[0]) {
+        score = (1 << 23) + 1;
+      } else if (m == ss->killers[1]) {
+        score = 1 << 23;
+      } else {
+        score = history[moved_piece(m)][m.destination];
+      }
+      if (m.promotion) score += 1 << 22;
+      scores[i] = score;
+    }
+  }
+
+  /// Move the best remaining move to position i.
+  static inline void pick_move(Stack::Frame *ss, size_t i) {
+    std::vector<Board::Move>& moves = ss->moves;
+    std::vector<int>& scores = ss->scores;
+    size_t best = i;
+    for (size_t j = i + 1; j < moves.size(); ++j) {
+      if (scores[j] > scores[best]) best = j;
+    }
+    std::swap(moves[i], moves[best]);
+    std::swap(scores[i], scores[best]);
+  }
+
+  static void update_quiet_stats(Stack::Frame *ss, const Board::Move& m, int depth) {
+    if (m != ss->killers[0]) {
+      ss->killers[1] = ss->killers[0];
+      ss->killers[0] = m;
+    }
+    int& h = history[moved_piece(m)][m.destination];
+    h += depth * depth;
+    // keep history below the killer scores.
+    if (h >= 1 << 20) {
+      for (auto& piece : history) for (int& x : piece) x /= 2;
+    }
+  }
+
+  /// ss is the search stack frame for this ply.
+  static value qsearch(Stack::Frame *ss, int ply, value alpha, value beta) {
+    ++nodes;
+    if (out_of_budget()) return 0;
+
+    bool in_check = Movegen::in_check();
+    if (Board::st) Board::st->in_check = in_check;
+    if (ply >= MAX_PLY - 1) return Eval::evaluate();
+
+    // in check we have to look at every move; otherwise only captures.
+    std::vector<Board::Move>& moves = ss->moves;
+    value best = -VALUE_INFINITE;
+    if (in_check) {
+      Movegen::generate<Movegen::EVASIONS>(moves);
+      if (moves.empty()) return -VALUE_MATE + ply;
+    } else {
+      // stand pat: we don't have to capture anything.
+      best = ss->static_eval = Eval::evaluate();
+      if (best >= beta) return best;
+      if (best > alpha) alpha = best;
+      Movegen::generate<Movegen::CAPTURES>(moves);
+    }
+
+    score_moves(ss, Board::Move());
+    for (size_t i = 0; i < moves.size(); ++i) {
+      pick_move(ss, i);
+      const Board::Move m = moves[i];
+      ss->make(m);
+      value v = -qsearch(ss + 1, ply + 1, -beta, -alpha);
+      ss->unmake(m);
+      if (stopped) return 0;
+
+      if (v > best) {
+        best = v;
+        if (v > alpha) {
+          alpha = v;
+          if (v >= beta) break;
+        }
+      }
+    }
+    return best;
+  }
+
+  static value negamax(Stack::Frame *ss, int depth, int ply, value alpha, value beta) {
+    if (depth <= 0) return qsearch(ss, ply, alpha, beta);
+    ++nodes;
+    if (out_of_budget()) return 0;
+
+    bool in_check = Movegen::in_check();
+    if (Board::st) Board::st->in_check = in_check;
+    if (ply > 0) {
+      Board::color loser;
+      if (repetitions(1, loser)) {
+        return loser == Board::to_move ? -VALUE_REPETITION + ply : VALUE_REPETITION - ply;
+      }
+      if (ply >= MAX_PLY - 1) return Eval::evaluate();
+
+      // a loaded tablebase knows the exact result, however deep.
+      Tablebase::Result tb;
+      if (Tablebase::probe(tb)) return tablebase_value(tb, ply);
+    }
+
+    COUNT(TT_PROBE);
+    TTEntry& entry = tt[Board::key & tt_mask];
+    bool tt_hit = entry.key32 == uint32_t(Board::key >> 32) && entry.flag != BOUND_NONE;
+    Board::Move tt_move = tt_hit ? entry.move : Board::Move();
+    if (tt_hit) {
+      COUNT(TT_HIT);
+      value v = value_from_tt(entry.score, ply);
+      if (ply > 0 && entry.depth >= depth
+          && (entry.flag == BOUND_EXACT
+              || (entry.flag == BOUND_LOWER && v >= beta)
+              || (entry.flag == BOUND_UPPER && v <= alpha))) {
+        return v;
+      }
+    }
+
+    // the static eval guides the pruning below; in check none of it applies.
+    value static_eval = ss->static_eval = in_check ? -VALUE_INFINITE : Eval::evaluate();
+    bool can_prune = ply > 0 && !in_check && std::abs(beta) < VALUE_MATE_IN_MAX_PLY;
+
+    if (selectivity.razoring && can_prune && depth <= 2 && tt_move == Board::Move()
+        && static_eval + RAZOR_MARGIN[depth]
+           + RAZOR_DROP_MARGIN * hand_kinds(Board::to_move) <= alpha) {
+      value v = qsearch(ss, ply, alpha, alpha + 1);
+      if (stopped) return 0;
+      if (v <= alpha) return v;
+    }
+
+    if (selectivity.null_move && can_prune && depth >= 3 && static_eval >= beta
+        && !Board::st->null_move && !zugzwang_risk(Board::to_move)) {
+      int reduction = 2 + depth / 4;
+      Board::do_null_move(ss->si);
+      value v = -negamax(ss + 1, depth - 1 - reduction, ply + 1, -beta, -beta + 1);
+      Board::undo_null_move();
+      if (stopped) return 0;
+      // don't trust a mate found by passing.
+      if (v >= beta) return v >= VALUE_MATE_IN_MAX_PLY ? beta : v;
+    }
+
+    std::vector<Board::Move>& moves = ss->moves;
+    Movegen::generate<Movegen::LEGAL>(moves);
+    // no moves is a loss in shogi, whether or not we are in check.
+    if (moves.empty()) return -VALUE_MATE + ply;
+
+    score_moves(ss, tt_move);
+    Board::square their_king = Movegen::king_sq(!Board::to_move);
+
+    value old_alpha = alpha;
+    value best = -VALUE_INFINITE;
+    Board::Move best_move;
+    int searched = 0;
+    for (size_t i = 0; i < moves.size(); ++i) {
+      pick_move(ss, i);
+      const Board::Move m = moves[i];
+      bool quiet = !is_capture(m);
+      if (ply == 0 && std::find(root_excluded.begin(), root_excluded.end(), m)
+                      != root_excluded.end()) {
+        continue;
+      }
+      bool tactical = !quiet || m.promotion || m == tt_move || m == ss->killers[0]
+                   || m == ss->killers[1] || drop_near(m, their_king);
+      int h = history[moved_piece(m)][m.destination];
+
+      ss->make(m);
+      bool gives_check = Movegen::in_check();
+
+      if (selectivity.futility && can_prune && depth <= 2 && searched > 0 && !tactical
+          && !gives_check && static_eval + FUTILITY_MARGIN[depth] <= alpha) {
+        ss->unmake(m);
+        best = std::max(best, static_eval + FUTILITY_MARGIN[depth]);
+        continue;
+      }
+
+      // extend checks by moves on the board, in the first half of the
+      // tree. Not drops: a piece in hand can give check almost every move,
+      // and extending those multiplies the tree several times over.
+      int new_depth = depth - 1;
+      if (selectivity.check_extensions && gives_check && m.pieceDrop == Piece::NO_PIECE
+          && ply < root_depth) ++new_depth;
+
+      value v;
+      int reduction = 0;
+      if (selectivity.lmr && depth >= 3 && searched >= 3 && !in_check && !tactical
+          && !gives_check) {
+        // later moves and moves without a history of cutoffs, more.
+        reduction = 1 + (searched >= 8) - (h > 0);
+        reduction = std::min(reduction, new_depth - 1);
+      }
+      if (reduction > 0) {
+        v = -negamax(ss + 1, new_depth - reduction, ply + 1, -alpha - 1, -alpha);
+        // it beat alpha after all: look again properly.
+        if (v > alpha && !stopped) v = -negamax(ss + 1, new_depth, ply + 1, -beta, -alpha);
+      } else {
+        v = -negamax(ss + 1, new_depth, ply + 1, -beta, -alpha);
+      }
+      ss->unmake(m);
+      if (stopped) return 0;
+      ++searched;
+
+      if (v > best) {
+        best = v;
+        best_move = m;
+        if (ply == 0) root_best = m;
+        if (v > alpha) {
+          alpha = v;
+          if (v >= beta) {
+            if (quiet) update_quiet_stats(ss, m, depth);
+            break;
+          }
+        }
+      }
+    }
+
+    // with moves excluded the root's score isn't the position's.
+    if (ply == 0 && !root_excluded.empty()) return best;
+    entry.key32 = uint32_t(Board::key >> 32);
+    entry.move = best_move;
+    entry.score = value_to_tt(best, ply);
+    entry.depth = depth;
+    entry.flag = best >= beta ? BOUND_LOWER : best > old_alpha ? BOUND_EXACT : BOUND_UPPER;
+    return best;
+  }
+
+  /// The table's move for the Board, if it has a legal one.
+  static Board::Move tt_move() {
+    const TTEntry& entry = tt[Board::key & tt_mask];
+    if (entry.key32 != uint32_t(Board::key >> 32) || entry.flag == BOUND_NONE) {
+      return Board::Move();
+    }
+    std::vector<Board::Move> moves = Movegen::legal();
+    bool legal = std::find(moves.begin(), moves.end(), entry.move) != moves.end();
+    return legal ? entry.move : Board::Move();
+  }
+
+  Result search(const Limits& limits) {
+    if (tt.empty()) set_hash_bits(DEFAULT_HASH_BITS);
+    nodes = 0;
+    node_limit = limits.nodes;
+    control = limits.control;
+    selectivity = limits.selectivity;
+    stopped = false;
+
+    Stack::Frame *ss = Stack::frames();
+    Result result;
+    int max_depth = std::min(limits.depth, MAX_PLY - 1);
+    // at least one root search even without legal moves, to score that.
+    size_t nb_lines = std::min<size_t>(std::max(limits.multi_pv, 1), Movegen::count_legal());
+    nb_lines = std::max<size_t>(nb_lines, 1);
+
+    int first_depth = 1;
+    if (limits.resume && nb_lines == 1) {
+      const TTEntry& entry = tt[Board::key & tt_mask];
+      Board::Move move = tt_move();
+      if (move != Board::Move() && entry.flag == BOUND_EXACT && entry.depth > 1) {
+        result.best = move;
+        result.score = value_from_tt(entry.score, 0);
+        result.depth = result.resumed_depth = std::min<int>(entry.depth, max_depth);
+        result.lines = {Line{result.best, result.score}};
+        first_depth = result.depth + 1;
+      }
+    }
+
+    std::vector<Line> lines;
+    for (root_depth = first_depth; root_depth <= max_depth; ++root_depth) {
+      lines.clear();
+      root_excluded.clear();
+      value first_score = 0;
+      for (size_t k = 0; k < nb_lines; ++k) {
+        root_best = Board::Move();
+        value v = negamax(ss, root_depth, 0, -VALUE_INFINITE, VALUE_INFINITE);
+        if (stopped) break;
+        if (k == 0) first_score = v;
+        if (root_best != Board::Move()) lines.push_back(Line{root_best, v});
+        root_excluded.push_back(root_best);
+      }
+      if (stopped) break;
+
+      // each line was searched with a full window, so they are in order
+      // unless the table made a later one look better.
+      std::stable_sort(lines.begin(), lines.end(),
+                       [](const Line& a, const Line& b) { return a.score > b.score; });
+      result.best = lines.empty() ? Board::Move() : lines[0].move;
+      result.score = lines.empty() ? first_score : lines[0].score;
+      result.depth = root_depth;
+      result.lines = lines;
+      // a forced mate won't get any shorter.
+      if (nb_lines == 1 && std::abs(result.score) >= VALUE_MATE_IN_MAX_PLY) break;
+    }
+    root_excluded.clear();
+    control = nullptr;
+
+    if (result.best != Board::Move()) {
+      Board::DefaultMaker maker;
+      maker.make(result.best);
+      result.ponder = tt_move();
+      maker.unmake(result.best);
+    }
+    result.nodes = nodes;
+    return result;
+  }
+}
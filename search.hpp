@@ -0,0 +1,104 @@
+#pragma once
+
+#include "board.hpp"
+#include "eval.hpp"
+#include "stack.hpp"
+#include <atomic>
+#include <cstdint>
+
+/*
+Iterative deepening alpha-beta search with a transposition table, killer
+moves and history, and a capture quiescence search. It is selective: null
+moves, late move reductions, futility pruning and razoring cut the tree down,
+and checks are extended (see Selectivity). With multi_pv > 1 each
+iteration searches the root once per line, each time without the moves
+already found, to get the best few moves with exact scores.
+
+If tablebases are loaded (see tablebase.hpp), every node below the root
+that they cover is scored exactly by probing instead of searching.
+
+Like the Board, all search state is thread_local: each thread searches its
+own Board with its own table and search stack (see stack.hpp), so any number
+of searches can run at once.
+*/
+
+namespace Search {
+  using Eval::value;
+
+  constexpr int MAX_PLY = Stack::MAX_PLY;
+  constexpr value VALUE_MATE     = 30000; // the player to move is mated
+  constexpr value VALUE_INFINITE = 30001;
+  constexpr value VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;
+
+  /// Lets another thread stop a search, or change its deadline while it
+  /// runs (e.g. pondering has no deadline until the ponder move is played).
+  /// Both are polled every few thousand nodes.
+  struct Control {
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> deadline{0}; // steady_clock milliseconds, 0 for none
+  };
+
+  /// Milliseconds on the clock Control::deadline is measured by.
+  int64_t now();
+
+  /// The selective search techniques, each of which can be switched off to
+  /// measure what it saves (see searchbench.hpp). Drops get extra care in
+  /// all of them: a quiet drop next to the enemy king is treated as
+  /// tactical, like a capture, and razoring allows for the drops qsearch
+  /// can't see.
+  struct Selectivity {
+    bool null_move = true;        // pass; if that still fails high, so will a move
+    bool lmr = true;              // search late quiet moves less deep first
+    bool futility = true;         // skip quiet moves near the leaves that can't raise alpha
+    bool razoring = true;         // drop into qsearch near the leaves when far below alpha
+    bool check_extensions = true; // search checking board moves a ply deeper
+  };
+
+  struct Limits {
+    int depth = MAX_PLY - 1;
+    uint64_t nodes = 0; // 0 for no limit
+    int multi_pv = 1;   // how many of the best root moves to score
+    Selectivity selectivity;
+    Control *control = nullptr;
+    /// Start from what the table already knows about the root: if it has
+    /// an exact score to some depth, take that as done and deepen from
+    /// there. For successive searches in one game, where the previous
+    /// search (or ponder) already looked at this position.
+    bool resume = false;
+  };
+
+  /// One of the best root moves, with its score for the player to move.
+  struct Line {
+    Board::Move move;
+    value score;
+  };
+
+  struct Result {
+    Board::Move best;    // Move() if there are no legal moves
+    value score = 0;     // for the player to move
+    int depth = 0;       // of the last completed iteration
+    uint64_t nodes = 0;
+    std::vector<Line> lines; // up to multi_pv of them, best first
+    Board::Move ponder;      // the expected reply to best, if the table has one
+    int resumed_depth = 0;   // depth taken from the table with Limits::resume
+  };
+
+  /// Search the Board until a limit is reached. The first iteration always
+  /// completes, so there is a best move whenever there is a legal one.
+  Result search(const Limits& limits);
+
+  /// Forget everything learned by previous searches on this thread. Until
+  /// this is called, each search starts with the table, killers and history
+  /// the previous one left, which helps when it is of a related position
+  /// (e.g. the next one in the same game).
+  void clear();
+  /// Resize this thread's transposition table to 2^bits entries and clear it.
+  void set_hash_bits(unsigned bits);
+
+  /// How many times has the current position occurred before? Walks back
+  /// through the StateInfo list until max_count earlier occurrences are found.
+  /// If there are any, loser is set to the player who loses by repetition:
+  /// whoever gave check with every move since the last occurrence, or sente
+  /// if neither did. This relies on StateInfo::in_check being filled in.
+  int repetitions(int max_count, Board::color& loser);
+}
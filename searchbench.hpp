@@ -0,0 +1,87 @@
+#pragma once
+
+#include "search.hpp"
+#include <chrono>
+#include <iostream>
+
+/* Header-only search bench: nodes and time to a fixed depth, with each
+   selective search technique switched off in turn. */
+
+namespace Search {
+namespace Bench {
+
+/// The start position and a spread of positions from self-play games.
+static const char *positions[] = {
+  "rbsgk/4p/5/P4/KGSBR b -",
+  "T3k/B1bsp/3g1/5/KGS2 b Rr",
+  "1D3/GRskp/2b2/P4/KG3 b Bs",
+  "3Hk/1s2p/r2b1/P2SR/KG3 w G",
+  "2T1k/2Bs1/2bgp/1S3/Kd3 b Rg",
+  "2H1k/r1s1g/3B1/PPS2/KG2R b -",
+  "T2gk/2bsp/D4/2KS1/2G1R b B",
+  "rs2k/b2gp/5/PG3/K3R b Bs",
+  "4k/H2gp/2r2/PK3/SGS1R b B",
+  "1b2k/P3g/r4/G4/K1rBS b PS",
+  "rb3/2gk1/3sR/P4/KGS2 b pb",
+  "1bg1k/3sp/P4/K2G1/3BR b Rs",
+};
+
+struct Totals {
+  uint64_t nodes = 0;
+  double seconds = 0;
+};
+
+/// Search every position to depth from a clear table.
+inline Totals run(int depth, const Selectivity& selectivity, bool verbose) {
+  Totals totals;
+  Limits limits;
+  limits.depth = depth;
+  limits.selectivity = selectivity;
+  for (const char *fen : positions) {
+    Board::importFEN(fen);
+    clear();
+    auto t0 = std::chrono::steady_clock::now();
+    Result r = search(limits);
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - t0;
+    totals.nodes += r.nodes;
+    totals.seconds += secs.count();
+    if (verbose) {
+      std::cout << fen << " depth " << r.depth << ": " << r.best << " " << r.score
+                << ", " << r.nodes << " nodes" << std::endl;
+    }
+  }
+  return totals;
+}
+
+/// Report nodes to depth with everything on, with everything off, and with
+/// each technique off on its own.
+inline void bench(int depth) {
+  struct Config {
+    const char *name;
+    bool Selectivity::*off;
+  };
+  static const Config configs[] = {
+    { "no null move", &Selectivity::null_move },
+    { "no LMR", &Selectivity::lmr },
+    { "no futility", &Selectivity::futility },
+    { "no razoring", &Selectivity::razoring },
+    { "no check extensions", &Selectivity::check_extensions },
+  };
+  auto report = [](const char *name, const Totals& t) {
+    std::cout << name << ": " << t.nodes << " nodes in " << t.seconds << "s, "
+              << (uint64_t)(t.nodes / t.seconds) << " nps" << std::endl;
+  };
+
+  Selectivity all;
+  report("all on", run(depth, all, true));
+  Selectivity none{false, false, false, false, false};
+  report("all off", run(depth, none, false));
+  for (const Config& config : configs) {
+    Selectivity s;
+    s.*config.off = false;
+    report(config.name, run(depth, s, false));
+  }
+}
+
+}
+}
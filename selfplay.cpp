@@ -0,0 +1,129 @@
+#include "selfplay.hpp"
+#include "movegen.hpp"
+#include "book.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace SelfPlay {
+  /// Play game number [index] on this thread's Board, appending its records.
+  /// Returns the result for sente: 1, 0 or -1.
+  static int play_game(const Options& options, uint64_t index, std::vector<Record>& records) {
+    std::mt19937_64 rng(options.seed * 0x9E3779B97F4A7C15ull + index);
+    Board::importFEN(Board::startFEN);
+    Search::clear();
+
+    // states[0] stands for the starting position so that repetitions of it
+    // are found too. Nothing ever undoes it.
+    std::vector<Board::StateInfo> states(options.max_plies + 1);
+    states[0].key = Board::key;
+    states[0].in_check = Movegen::in_check();
+    Board::st = &states[0];
+
+    size_t first_record = records.size();
+    std::vector<Board::color> movers;
+    int result = 0;
+    for (int ply = 0; ; ++ply) {
+      std::vector<Board::Move> moves = Movegen::legal();
+      Board::color loser;
+      if (moves.empty()) {
+        result = Board::to_move == Board::SENTE ? -1 : 1;
+        break;
+      }
+      if (Search::repetitions(3, loser) == 3) {
+        result = loser == Board::SENTE ? -1 : 1;
+        break;
+      }
+      if (ply >= options.max_plies) break;
+
+      Board::Move m;
+      if (ply < options.random_plies) {
+        if (!options.use_book || !Book::probe(rng, m)) m = moves[rng() % moves.size()];
+      } else {
+        Search::Result r = Search::search(options.limits);
+        m = r.best;
+
+        Record record;
+        if (Packed::encode(record.position)) {
+          record.score = r.score;
+          record.ply = std::min(ply, 255);
+          records.push_back(record);
+          movers.push_back(Board::to_move);
+        }
+      }
+
+      Board::do_move(m, states[ply + 1]);
+      Board::st->in_check = Movegen::in_check();
+    }
+
+    for (size_t i = first_record; i < records.size(); ++i) {
+      records[i].result = movers[i - first_record] == Board::SENTE ? result : -result;
+    }
+    Board::st = NULL;
+    return result;
+  }
+
+  Stats run(const Options& options, const std::string& path, std::ostream& log) {
+    Stats stats;
+    Packed::Writer<Record> out(path);
+    if (!out.is_open()) {
+      log << "can't write " << path << std::endl;
+      return stats;
+    }
+
+    std::atomic<uint64_t> next_game{0};
+    std::mutex mutex; // guards out, stats and log
+    uint64_t report_every = std::max<uint64_t>(1, options.games / 10);
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+      std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+      return secs.count();
+    };
+
+    auto worker = [&]() {
+      std::vector<Record> records;
+      for (uint64_t game; (game = next_game++) < options.games; ) {
+        records.clear();
+        int result = play_game(options, game, records);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Record& record : records) out.write(record);
+        stats.games++;
+        stats.positions += records.size();
+        if (result > 0) {
+          stats.wins[Board::SENTE]++;
+        } else if (result < 0) {
+          stats.wins[Board::GOTE]++;
+        } else {
+          stats.draws++;
+        }
+        if (stats.games % report_every == 0) {
+          log << stats.games << " games, " << stats.positions << " positions, "
+              << elapsed() << "s" << std::endl;
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < std::max(options.threads, 1u); ++i) {
+      threads.emplace_back(worker);
+    }
+    for (std::thread& t : threads) t.join();
+    if (!out.close()) {
+      // nothing played is saved.
+      log << "can't write " << path << std::endl;
+      return Stats();
+    }
+
+    stats.seconds = elapsed();
+    log << "played " << stats.games << " games (sente " << stats.wins[Board::SENTE]
+        << ", gote " << stats.wins[Board::GOTE] << ", draws " << stats.draws
+        << ") on " << threads.size() << " threads in " << stats.seconds << "s" << std::endl;
+    log << (stats.games / stats.seconds) << " games/s, "
+        << (uint64_t)(stats.positions / stats.seconds) << " positions/s" << std::endl;
+    return stats;
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "packed.hpp"
+#include "search.hpp"
+#include <iostream>
+#include <string>
+
+/*
+Self-play game generation, for producing labeled positions to tune the
+evaluation with.
+
+Games start from startFEN with a few opening moves so that they differ:
+from the opening book if one is loaded and has the position (see book.hpp),
+otherwise random. Then both sides play by search with fixed limits. Every
+searched position is written to a Packed record file along with its search
+score and the game's result. Games run concurrently, one per worker thread at a time; each worker
+has its own Board and search state (see board.hpp and search.hpp).
+
+Games end when the player to move has no legal moves (and loses), on the
+fourth occurrence of a position (sennichite: sente loses unless the other
+side was giving perpetual check), or as draws at the move limit.
+*/
+
+namespace SelfPlay {
+  /// One searched position. Score and result are both for the player to
+  /// move: result is 1 for a win, 0 for a draw, -1 for a loss.
+  struct Record {
+    Packed::Position position;
+    int16_t score;
+    int8_t result;
+    uint8_t ply;    // in the game, counting the random opening moves
+  };
+  static_assert(sizeof(Record) == 20, "Record should stay compact");
+
+  struct Options {
+    uint64_t games = 1000;
+    unsigned threads = 1;
+    Search::Limits limits;
+    int random_plies = 8; // book or random moves played before searching
+    bool use_book = false; // take opening moves from the loaded Book
+    int max_plies = 200;  // the game is a draw after this many
+    uint64_t seed = 1;    // game i is the same in every run with this seed
+  };
+
+  struct Stats {
+    uint64_t games = 0;
+    uint64_t positions = 0;
+    uint64_t wins[2] = {0, 0}; // indexed by color
+    uint64_t draws = 0;
+    double seconds = 0;
+  };
+
+  /// Play options.games games and write their records to path. Progress and
+  /// a summary with games/s and positions/s go to log. If the file can't be
+  /// written, the Stats come back empty.
+  Stats run(const Options& options, const std::string& path, std::ostream& log);
+}
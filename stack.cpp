@@ -0,0 +1,7 @@
+#include "stack.hpp"
+
+namespace Stack {
+  static thread_local Frame stack[MAX_PLY + SCRATCH];
+
+  Frame *frames() { return stack; }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "board.hpp"
+#include <vector>
+
+/*
+Per-thread search stack: what search and perft keep for each ply, allocated
+once per thread in one cache-aligned block and indexed by ply.
+
+Frame p holds the StateInfo of the move made at ply p, so its prev is frame
+p-1's right next to it rather than somewhere up the call stack, and the
+Snapshot copy-make restores it from. The move list and its ordering scores
+keep their capacity from one search to the next, so generating moves doesn't
+allocate once the stack is warm. Search also keeps its killers and static
+evals here.
+
+Movegen's probe moves (made only to see whether they leave a king in check)
+use the scratch frames past the last ply. They nest at most SCRATCH deep and
+are undone before the probe returns.
+*/
+
+namespace Stack {
+  constexpr int MAX_PLY = 64;
+  constexpr int SCRATCH = 2;
+
+  struct alignas(64) Frame {
+    Board::StateInfo si;
+    Board::Snapshot saved;
+    std::vector<Board::Move> moves;
+    std::vector<int> scores;
+    Board::Move killers[2];
+    int static_eval = 0;
+
+    /// Make m into this frame's StateInfo; take it back with unmake. See
+    /// Board::make.
+    template <bool CopyMake = Board::COPY_MAKE_DEFAULT>
+    void make(Board::Move m) { Board::make<CopyMake>(m, si, saved); }
+    template <bool CopyMake = Board::COPY_MAKE_DEFAULT>
+    void unmake(Board::Move m) { Board::unmake<CopyMake>(m, saved); }
+  };
+
+  /// This thread's frames: MAX_PLY for plies, then SCRATCH for probes.
+  /// Look it up once per search and index it, rather than per ply.
+  Frame *frames();
+  /// Scratch frame i of this thread.
+  inline Frame& scratch(int i) { return frames()[MAX_PLY + i]; }
+}
@@ -0,0 +1,400 @@
+#include "tablebase.hpp"
+#include "mapped.hpp"
+#include "movegen.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+namespace Tablebase {
+
+  static constexpr uint64_t NO_INDEX = ~0ull;
+  static constexpr unsigned MAX_PIECES = 10; // everything but the kings
+
+  /* Indexing.
+
+  index = ((to_move * 25 + sente king) * 25 + gote king), then for every
+  other piece, index = index * (number of locations) + location, where a
+  location is one of
+    square + 25 * owner + 50 * promoted   (promoted only if it can promote)
+    then one slot for each player's hand.
+  Identical pieces are interchangeable, so only the ordering with their
+  locations ascending is used. Every other index decodes as ILLEGAL, along
+  with kings on top of things, nifu, and so on. */
+
+  static unsigned nb_locations(Piece::piece_type pt) {
+    return Piece::can_promote(pt) ? 102 : 52;
+  }
+  static unsigned hand_location(Piece::piece_type pt, Board::color c) {
+    return (Piece::can_promote(pt) ? 100 : 50) + c;
+  }
+
+  /// The material a table covers, and its size.
+  struct Layout {
+    Piece::piece_type material[MAX_PIECES]; // sorted by piece type
+    unsigned nb_pieces = 0;
+    uint8_t count[Piece::NB_UNPROMOTED]{};
+    uint64_t size = 0;
+
+    bool parse(const std::string& s) {
+      static const char letters[] = " PSGBR"; // indexed by piece type
+      nb_pieces = 0;
+      std::memset(count, 0, sizeof(count));
+
+      for (char c : s) {
+        const char *p = std::strchr(letters + 1, std::toupper(c));
+        if (c == 0 || p == nullptr || nb_pieces == MAX_PIECES) return false;
+        Piece::piece_type pt = p - letters;
+        // minishogi only has two of everything.
+        if (++count[pt] > 2) return false;
+        material[nb_pieces++] = pt;
+      }
+      std::sort(material, material + nb_pieces);
+
+      size = 2 * 25 * 25;
+      for (unsigned i = 0; i < nb_pieces; ++i) size *= nb_locations(material[i]);
+      return true;
+    }
+
+    std::string name() const {
+      static const char letters[] = " PSGBR";
+      std::string s;
+      for (unsigned i = 0; i < nb_pieces; ++i) s += letters[material[i]];
+      return s;
+    }
+
+    /// Index of a position, or NO_INDEX if it has the wrong material.
+    /// The position is not checked for legality.
+    uint64_t index(const Board::Position& pos) const {
+      Board::square king[2] = {25, 25};
+      unsigned codes[Piece::NB_UNPROMOTED][2];
+      uint8_t found[Piece::NB_UNPROMOTED]{};
+
+      for (Board::square sq = 0; sq < 25; ++sq) {
+        Piece::piece p = pos.squares[sq];
+        if (p == Piece::NO_PIECE) continue;
+        Board::color c = Piece::color(p);
+        Piece::piece_type pt = Piece::upt(p);
+
+        if (pt == Piece::KING) {
+          if (king[c] != 25) return NO_INDEX;
+          king[c] = sq;
+        } else {
+          if (found[pt] == count[pt]) return NO_INDEX;
+          codes[pt][found[pt]++] = sq + 25 * c + 50 * Piece::is_promoted(p);
+        }
+      }
+      if (king[Board::SENTE] == 25 || king[Board::GOTE] == 25) return NO_INDEX;
+
+      for (Board::color c : Board::colors) {
+        for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+          for (unsigned n = 0; n < pos.hand[c][pt]; ++n) {
+            if (found[pt] == count[pt]) return NO_INDEX;
+            codes[pt][found[pt]++] = hand_location(pt, c);
+          }
+        }
+      }
+
+      uint64_t idx = (pos.to_move * 25 + king[Board::SENTE]) * 25 + king[Board::GOTE];
+      for (unsigned i = 0; i < nb_pieces; ) {
+        Piece::piece_type pt = material[i];
+        if (found[pt] != count[pt]) return NO_INDEX;
+        if (count[pt] == 2 && codes[pt][0] > codes[pt][1]) {
+          std::swap(codes[pt][0], codes[pt][1]);
+        }
+        for (unsigned n = 0; n < count[pt]; ++n, ++i) {
+          idx = idx * nb_locations(pt) + codes[pt][n];
+        }
+      }
+      return idx;
+    }
+
+    /// Set up the position with the given index. Returns false if the
+    /// index doesn't describe a legal position.
+    bool decode(uint64_t idx, Board::Position& pos) const {
+      std::memset(&pos, 0, sizeof(pos));
+
+      unsigned codes[MAX_PIECES];
+      for (unsigned i = nb_pieces; i-- > 0; ) {
+        codes[i] = idx % nb_locations(material[i]);
+        idx /= nb_locations(material[i]);
+      }
+      Board::square king[2];
+      king[Board::GOTE] = idx % 25;
+      idx /= 25;
+      king[Board::SENTE] = idx % 25;
+      pos.to_move = idx / 25;
+
+      if (king[Board::SENTE] == king[Board::GOTE]) return false;
+      for (Board::color c : Board::colors) {
+        pos.squares[king[c]] = Piece::color_piece(Piece::KING, c);
+      }
+
+      for (unsigned i = 0; i < nb_pieces; ++i) {
+        Piece::piece_type pt = material[i];
+        unsigned code = codes[i];
+        if (i > 0 && material[i-1] == pt && codes[i-1] > code) return false;
+
+        if (code >= hand_location(pt, Board::SENTE)) {
+          pos.hand[code - hand_location(pt, Board::SENTE)][pt]++;
+          continue;
+        }
+
+        Board::square sq = code % 25;
+        Board::color c = (code / 25) & 1;
+        if (pos.squares[sq] != Piece::NO_PIECE) return false;
+        Piece::piece p = Piece::color_piece(pt, c);
+        if (code >= 50) p = Piece::promote(p);
+
+        if (p == Piece::color_piece(Piece::PAWN, c)) {
+          // unpromoted pawns can't be on the last rank, and nifu.
+          if (Board::in_promo_zone(sq, c)) return false;
+          for (Board::square other = sq % 5; other < 25; other += 5) {
+            if (pos.squares[other] == p) return false;
+          }
+        }
+        pos.squares[sq] = p;
+      }
+
+      // the player to move must not be able to take the enemy king.
+      return !attacks_square(pos, pos.to_move, king[!pos.to_move]);
+    }
+
+    static bool attacks_square(const Board::Position& pos, Board::color c, Board::square target) {
+      Bitboard::bitboard occupied = 0;
+      for (Board::square sq = 0; sq < 25; ++sq) {
+        if (pos.squares[sq] != Piece::NO_PIECE) occupied |= Bitboard::square_bb(sq);
+      }
+      for (Board::square sq = 0; sq < 25; ++sq) {
+        Piece::piece p = pos.squares[sq];
+        if (p == Piece::NO_PIECE || Piece::color(p) != c) continue;
+        if (Movegen::attacks(p, c, sq, occupied) & Bitboard::square_bb(target)) {
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+
+  /// Call emit(parent) with every position that has a legal move to pos.
+  /// mated says whether pos is checkmate, in which case it can't have been
+  /// reached by dropping a pawn (unless that is allowed).
+  template <typename Emit>
+  static void unmoves(const Board::Position& pos, bool mated, Emit emit) {
+    Board::color mover = !pos.to_move;
+    Board::color victim_color = pos.to_move;
+
+    Bitboard::bitboard occupied = 0;
+    Board::square their_king = 25;
+    for (Board::square sq = 0; sq < 25; ++sq) {
+      Piece::piece p = pos.squares[sq];
+      if (p == Piece::NO_PIECE) continue;
+      occupied |= Bitboard::square_bb(sq);
+      if (p == Piece::color_piece(Piece::KING, victim_color)) their_king = sq;
+    }
+
+    for (Board::square dest = 0; dest < 25; ++dest) {
+      Piece::piece moved = pos.squares[dest];
+      if (moved == Piece::NO_PIECE || Piece::color(moved) != mover) continue;
+
+      // un-drop it back to hand.
+      if (!Piece::is_promoted(moved) && Piece::type(moved) != Piece::KING) {
+        bool drop_pawn_mate = Piece::type(moved) == Piece::PAWN && mated
+          && !Movegen::allow_drop_pawn_checkmate
+          && (Movegen::attacks(moved, mover, dest, occupied)
+              & Bitboard::square_bb(their_king));
+        if (!drop_pawn_mate) {
+          Board::Position parent = pos;
+          parent.squares[dest] = Piece::NO_PIECE;
+          parent.hand[mover][Piece::type(moved)]++;
+          parent.to_move = mover;
+          emit(parent);
+        }
+      }
+
+      // un-move it, un-promoting if it might have promoted on the way.
+      for (bool promoted : {false, true}) {
+        Piece::piece before = moved;
+        if (promoted) {
+          if (!Piece::is_promoted(moved)) continue;
+          before = Piece::demote(moved);
+          if (!Piece::can_promote(before)) continue;
+        }
+
+        for (Board::square orig = 0; orig < 25; ++orig) {
+          if (pos.squares[orig] != Piece::NO_PIECE) continue;
+          if (!(Movegen::attacks(before, mover, orig, occupied) & Bitboard::square_bb(dest))) {
+            continue;
+          }
+          if (promoted && !Board::in_promo_zone(orig, mover)
+                       && !Board::in_promo_zone(dest, mover)) {
+            continue;
+          }
+
+          Board::Position parent = pos;
+          parent.squares[orig] = before;
+          parent.squares[dest] = Piece::NO_PIECE;
+          parent.to_move = mover;
+          emit(parent);
+
+          // un-capture: anything in the mover's hand might have been taken
+          // on dest, possibly promoted.
+          for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+            if (pos.hand[mover][pt] == 0) continue;
+            Board::Position captured = parent;
+            captured.hand[mover][pt]--;
+            captured.squares[dest] = Piece::color_piece(pt, victim_color);
+            emit(captured);
+            if (Piece::can_promote(pt)) {
+              captured.squares[dest] = Piece::promote(captured.squares[dest]);
+              emit(captured);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /* Table files: a fixed-size header, then one little-endian uint16_t per
+  index. */
+
+  struct Header {
+    char magic[8];
+    char material[MAX_PIECES + 1];
+    uint8_t allow_drop_pawn_checkmate;
+    uint8_t unused[4];
+    uint64_t size;
+  };
+  static const char MAGIC[8] = {'T', 'S', 'H', 'O', 'T', 'B', '0', '2'};
+
+  bool generate(const std::string& material, const std::string& path,
+                std::ostream& log) {
+    Layout layout;
+    if (!layout.parse(material)) return false;
+
+    log << "generating " << layout.name() << ": " << layout.size
+        << " positions" << std::endl;
+
+    std::vector<uint16_t> values(layout.size, ILLEGAL);
+    // number of moves not yet known to lose for the opponent.
+    std::vector<uint16_t> remaining(layout.size, 0);
+    std::vector<uint64_t> frontier, next;
+    Board::Position pos;
+
+    // checkmates (and positions with no moves at all) are lost in 0.
+    for (uint64_t idx = 0; idx < layout.size; ++idx) {
+      if (!layout.decode(idx, pos)) continue;
+      Board::set_position(pos);
+      size_t nb_moves = Movegen::count_legal();
+      if (nb_moves == 0) {
+        values[idx] = 1;
+        frontier.push_back(idx);
+      } else {
+        values[idx] = DRAW;
+        remaining[idx] = nb_moves;
+      }
+    }
+
+    // Then, a position is won in n+1 if any move reaches a loss in n,
+    // and lost in n+1 once every move reaches a win, the last in n.
+    unsigned plies = 0;
+    for ( ; !frontier.empty() && plies + 2 < ILLEGAL; ++plies) {
+      bool lost = plies % 2 == 0;
+      log << "  " << plies << " plies: " << frontier.size()
+          << (lost ? " losses" : " wins") << std::endl;
+
+      next.clear();
+      for (uint64_t idx : frontier) {
+        layout.decode(idx, pos);
+        unmoves(pos, plies == 0, [&](const Board::Position& parent) {
+          uint64_t p = layout.index(parent);
+          if (p == NO_INDEX || values[p] != DRAW) return;
+          if (lost || --remaining[p] == 0) {
+            values[p] = plies + 2;
+            next.push_back(p);
+          }
+        });
+      }
+      frontier.swap(next);
+    }
+    if (!frontier.empty()) {
+      // everything left would be stored as a draw.
+      log << "  mates longer than " << plies << " plies don't fit" << std::endl;
+      return false;
+    }
+
+    uint64_t counts[3]{}; // draws, wins, losses
+    for (uint16_t v : values) {
+      if (v == ILLEGAL) continue;
+      counts[v == DRAW ? 0 : (v - 1) % 2 ? 1 : 2]++;
+    }
+    log << "  " << counts[1] << " wins, " << counts[2] << " losses, "
+        << counts[0] << " draws, longest mate " << (plies ? plies - 1 : 0)
+        << " plies" << std::endl;
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    std::strncpy(header.material, layout.name().c_str(), MAX_PIECES);
+    header.allow_drop_pawn_checkmate = Movegen::allow_drop_pawn_checkmate;
+    header.size = layout.size;
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(values.data()),
+              values.size() * sizeof(uint16_t));
+    return out.good();
+  }
+
+  struct Table {
+    Layout layout;
+    bool allow_drop_pawn_checkmate;
+    Mapped::File file;
+  };
+  static std::vector<Table> tables;
+
+  bool load(const std::string& path) {
+    Table table;
+    if (!table.file.open(path) || table.file.size() < sizeof(Header)) return false;
+
+    Header header;
+    std::memcpy(&header, table.file.data(), sizeof(header));
+    header.material[MAX_PIECES] = 0;
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || !table.layout.parse(header.material)
+        || header.size != table.layout.size
+        || table.file.size() != sizeof(Header) + header.size * sizeof(uint16_t)) {
+      return false;
+    }
+    table.allow_drop_pawn_checkmate = header.allow_drop_pawn_checkmate;
+
+    tables.push_back(std::move(table));
+    return true;
+  }
+
+  bool probe(Result& result) {
+    // search probes at every node, whether or not any tables are loaded.
+    if (tables.empty()) return false;
+    Board::Position pos;
+    Board::get_position(pos);
+
+    for (const Table& table : tables) {
+      if (table.allow_drop_pawn_checkmate != Movegen::allow_drop_pawn_checkmate) {
+        continue;
+      }
+      uint64_t idx = table.layout.index(pos);
+      if (idx == NO_INDEX) continue;
+
+      uint16_t v;
+      std::memcpy(&v, table.file.data() + sizeof(Header) + idx * sizeof(v), sizeof(v));
+      if (v == ILLEGAL) return false;
+      if (v == DRAW) {
+        result = {0, 0};
+      } else {
+        int plies = v - 1;
+        result = {plies % 2 ? 1 : -1, plies};
+      }
+      return true;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "board.hpp"
+#include <iostream>
+#include <string>
+
+/*
+Retrograde endgame tablebases for reduced-material minishogi.
+
+A table covers every position with the two kings plus a fixed set of other
+pieces, named by their unpromoted letters: "G" is one gold, "SP" a silver
+and a pawn. Each of those pieces may be on any square, owned by either
+player and promoted or not, or in either player's hand, so the set of
+positions is closed under captures and drops and can be solved exactly.
+(Pieces never leave a real game, so tables apply to problems and analysis
+positions with material removed, not to positions reached from startFEN.)
+
+Tables are solved backwards from the checkmates, using an un-move generator
+that also un-drops pieces back to hand and un-captures pieces out of hand.
+Every position gets two bytes, enough for any mate a table can hold, and the
+file is memory-mapped when probed.
+*/
+
+namespace Tablebase {
+  /// Per-position values, from the point of view of the player to move.
+  /// Any other value is the distance to mate in plies, plus one: odd
+  /// distances are wins for the player to move, even ones are losses.
+  constexpr uint16_t DRAW    = 0;      // or never reached by retrograde analysis
+  constexpr uint16_t ILLEGAL = 0xFFFF; // index doesn't describe a legal position
+
+  struct Result {
+    int wdl;   // 1 win, 0 draw, -1 loss for the player to move
+    int plies; // distance to mate; 0 for draws
+  };
+
+  /// Generate and solve the table for the given material (e.g. "GP"), and
+  /// write it to path, logging progress to log. Clobbers the Board. Returns
+  /// false if the material can't be parsed, some mate is too long to store,
+  /// or the file can't be written.
+  bool generate(const std::string& material, const std::string& path,
+                std::ostream& log);
+
+  /// Memory-map a table file so that probe() can use it.
+  bool load(const std::string& path);
+
+  /// Look up the current Board position in the loaded tables. Returns false
+  /// if no loaded table covers it.
+  bool probe(Result& result);
+}
@@ -0,0 +1,268 @@
+#include "tune.hpp"
+#include "packed.hpp"
+#include "selfplay.hpp"
+#include "search.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+namespace Tune {
+  /// Run fn(thread, begin, end) over [0, n) split evenly across threads.
+  template <typename F>
+  static void parallel_for(unsigned nb_threads, size_t n, F fn) {
+    nb_threads = std::max(nb_threads, 1u);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nb_threads; ++t) {
+      size_t begin = n * t / nb_threads, end = n * (t + 1) / nb_threads;
+      threads.emplace_back(fn, t, begin, end);
+    }
+    for (std::thread& t : threads) t.join();
+  }
+
+  /// Append the Board's features to data.
+  static void add_position(Dataset& data, float target) {
+    int8_t counts[NB_DENSE]{};
+    for (Board::color c : Board::colors) {
+      int8_t sign = c == Board::SENTE ? 1 : -1;
+      for (Bitboard::bitboard b = Board::occupancy_bb[c]; b; ) {
+        Board::square sq = Bitboard::pop_lsb(b);
+        Piece::piece_type pt = Piece::type(Board::Square[sq]);
+        counts[pt] += sign;
+        data.psq_index.push_back(PSQ_BASE + pt * 25 + Eval::relative_square(c, sq));
+        data.psq_sign.push_back(sign);
+      }
+      for (Piece::piece_type pt = Piece::PAWN; pt < Piece::NB_UNPROMOTED; ++pt) {
+        counts[HAND_BASE + pt] += sign * Board::hand[c][pt];
+      }
+    }
+    for (unsigned j = 0; j < NB_DENSE; ++j) data.dense[j].push_back(counts[j]);
+    data.psq_begin.push_back(data.psq_index.size());
+    data.target.push_back(target);
+    data.size++;
+  }
+
+  bool load(const std::string& path, Dataset& data, unsigned nb_threads) {
+    Packed::Reader<SelfPlay::Record> in;
+    if (!in.open(path)) return false;
+
+    // each thread decodes its share on its own Board, then the parts are
+    // concatenated in order.
+    nb_threads = std::max(nb_threads, 1u);
+    std::vector<Dataset> parts(nb_threads);
+    parallel_for(nb_threads, in.size(), [&](unsigned t, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const SelfPlay::Record& record = in[i];
+        if (std::abs(record.score) >= Search::VALUE_MATE_IN_MAX_PLY) continue;
+        Packed::decode(record.position);
+        int result = Board::to_move == Board::SENTE ? record.result : -record.result;
+        add_position(parts[t], (result + 1) / 2.0f);
+      }
+    });
+
+    for (const Dataset& part : parts) {
+      for (unsigned j = 0; j < NB_DENSE; ++j) {
+        data.dense[j].insert(data.dense[j].end(), part.dense[j].begin(), part.dense[j].end());
+      }
+      uint64_t offset = data.psq_index.size();
+      for (size_t i = 1; i < part.psq_begin.size(); ++i) {
+        data.psq_begin.push_back(part.psq_begin[i] + offset);
+      }
+      data.psq_index.insert(data.psq_index.end(), part.psq_index.begin(), part.psq_index.end());
+      data.psq_sign.insert(data.psq_sign.end(), part.psq_sign.begin(), part.psq_sign.end());
+      data.target.insert(data.target.end(), part.target.begin(), part.target.end());
+      data.size += part.size;
+    }
+
+    data.dense_used.clear();
+    for (unsigned j = 0; j < NB_DENSE; ++j) {
+      for (int8_t x : data.dense[j]) {
+        if (x) {
+          data.dense_used.push_back(j);
+          break;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::vector<double> current_weights() {
+    std::vector<double> weights(NB_WEIGHTS);
+    for (unsigned pt = 0; pt < Piece::NB_PIECE_TYPES; ++pt) {
+      weights[pt] = Eval::piece_value[pt];
+      for (unsigned sq = 0; sq < 25; ++sq) weights[PSQ_BASE + pt * 25 + sq] = Eval::psq[pt][sq];
+    }
+    for (unsigned pt = 0; pt < Piece::NB_UNPROMOTED; ++pt) {
+      weights[HAND_BASE + pt] = Eval::hand_value[pt];
+    }
+    return weights;
+  }
+
+  /// Evaluate positions [begin, end) into eval, and return their summed
+  /// squared error. If grad is given, add the error's gradient to it.
+  static double pass(
+    const Dataset& data, const std::vector<double>& weights, double k,
+    size_t begin, size_t end, std::vector<float>& eval, double *grad
+  ) {
+    size_t n = end - begin;
+    eval.assign(n, 0.0f);
+    float *e = eval.data();
+
+    for (unsigned j : data.dense_used) {
+      float w = weights[j];
+      const int8_t *column = data.dense[j].data() + begin;
+      for (size_t i = 0; i < n; ++i) e[i] += w * column[i];
+    }
+    for (size_t i = 0; i < n; ++i) {
+      float sum = 0;
+      for (uint64_t f = data.psq_begin[begin + i]; f < data.psq_begin[begin + i + 1]; ++f) {
+        sum += weights[data.psq_index[f]] * data.psq_sign[f];
+      }
+      e[i] += sum;
+    }
+
+    // from here on e holds the derivative of each error by its eval.
+    double error = 0;
+    const float *target = data.target.data() + begin;
+    for (size_t i = 0; i < n; ++i) {
+      float s = 1.0f / (1.0f + std::exp(-float(k) * e[i]));
+      float diff = s - target[i];
+      error += diff * diff;
+      e[i] = 2 * diff * s * (1 - s) * float(k);
+    }
+    if (!grad) return error;
+
+    for (unsigned j : data.dense_used) {
+      const int8_t *column = data.dense[j].data() + begin;
+      // separate partial sums, so the compiler is free to vectorize.
+      float partial[8]{};
+      size_t i = 0;
+      for ( ; i + 8 <= n; i += 8) {
+        for (unsigned lane = 0; lane < 8; ++lane) partial[lane] += e[i + lane] * column[i + lane];
+      }
+      for ( ; i < n; ++i) partial[0] += e[i] * column[i];
+      for (float p : partial) grad[j] += p;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      for (uint64_t f = data.psq_begin[begin + i]; f < data.psq_begin[begin + i + 1]; ++f) {
+        grad[data.psq_index[f]] += e[i] * data.psq_sign[f];
+      }
+    }
+    return error;
+  }
+
+  /// Mean squared error over the whole dataset, and its gradient if given.
+  static double loss(
+    const Dataset& data, const std::vector<double>& weights, double k,
+    unsigned nb_threads, std::vector<double> *grad
+  ) {
+    nb_threads = std::max(nb_threads, 1u);
+    std::vector<double> errors(nb_threads);
+    std::vector<std::vector<double>> grads(nb_threads);
+    parallel_for(nb_threads, data.size, [&](unsigned t, size_t begin, size_t end) {
+      std::vector<float> eval;
+      if (grad) grads[t].assign(NB_WEIGHTS, 0.0);
+      errors[t] = pass(data, weights, k, begin, end, eval, grad ? grads[t].data() : nullptr);
+    });
+
+    double error = 0;
+    for (double e : errors) error += e;
+    if (grad) {
+      grad->assign(NB_WEIGHTS, 0.0);
+      for (const std::vector<double>& g : grads) {
+        for (unsigned j = 0; j < NB_WEIGHTS; ++j) (*grad)[j] += g[j] / data.size;
+      }
+    }
+    return error / data.size;
+  }
+
+  /// The sigmoid scale that best fits the starting weights, by golden
+  /// section search.
+  static double fit_k(const Dataset& data, const std::vector<double>& weights, unsigned nb_threads) {
+    const double ratio = (std::sqrt(5.0) - 1) / 2;
+    double lo = 1e-4, hi = 0.05;
+    for (int i = 0; i < 30; ++i) {
+      double a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+      if (loss(data, weights, a, nb_threads, nullptr) < loss(data, weights, b, nb_threads, nullptr)) {
+        hi = b;
+      } else {
+        lo = a;
+      }
+    }
+    return (lo + hi) / 2;
+  }
+
+  double tune(const Dataset& data, std::vector<double>& weights,
+              const Options& options, std::ostream& log) {
+    if (data.size == 0) return 0;
+    double k = fit_k(data, weights, options.threads);
+    log << data.size << " positions, k = " << k << ", loss "
+        << loss(data, weights, k, options.threads, nullptr) << std::endl;
+
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    std::vector<double> m(NB_WEIGHTS), v(NB_WEIGHTS), grad;
+    int report_every = std::max(1, options.epochs / 10);
+    double error = 0;
+    for (int epoch = 1; epoch <= options.epochs; ++epoch) {
+      error = loss(data, weights, k, options.threads, &grad);
+      double correction1 = 1 - std::pow(beta1, epoch);
+      double correction2 = 1 - std::pow(beta2, epoch);
+      for (unsigned j = 0; j < NB_WEIGHTS; ++j) {
+        m[j] = beta1 * m[j] + (1 - beta1) * grad[j];
+        v[j] = beta2 * v[j] + (1 - beta2) * grad[j] * grad[j];
+        weights[j] -= options.learning_rate * (m[j] / correction1)
+                    / (std::sqrt(v[j] / correction2) + epsilon);
+      }
+      if (epoch % report_every == 0) log << "epoch " << epoch << " loss " << error << std::endl;
+    }
+    return loss(data, weights, k, options.threads, nullptr);
+  }
+
+  static const char *type_names[Piece::NB_PIECE_TYPES] = {
+    "-", "pawn", "silver", "gold", "bishop", "rook", "king", "-",
+    "-", "tokin", "promoted silver", "-", "horse", "dragon",
+  };
+
+  bool write_header(const std::string& path, const std::vector<double>& weights) {
+    std::ofstream out(path);
+    if (!out) return false;
+    auto w = [&weights](unsigned j) { return (int)std::lround(weights[j]); };
+
+    out << "#pragma once\n\n"
+        << "#include \"piece.hpp\"\n\n"
+        << "/*\n"
+        << "Evaluation weights, in centipawns. Generated by `./main tune`; edit by hand\n"
+        << "only to seed a tuning run.\n"
+        << "*/\n\n"
+        << "namespace Eval {\n";
+
+    out << "  /// Value of each piece type on the board.\n"
+        << "  inline constexpr int piece_value[Piece::NB_PIECE_TYPES] = {\n   ";
+    for (unsigned pt = 0; pt < Piece::NB_PIECE_TYPES; ++pt) out << ' ' << w(pt) << ',';
+    out << "\n  };\n\n";
+
+    out << "  /// Value of each piece type in hand.\n"
+        << "  inline constexpr int hand_value[Piece::NB_UNPROMOTED] = {\n   ";
+    for (unsigned pt = 0; pt < Piece::NB_UNPROMOTED; ++pt) out << ' ' << w(HAND_BASE + pt) << ',';
+    out << "\n  };\n\n";
+
+    out << "  /// Bonus for each piece type on each square, from sente's side of the\n"
+        << "  /// board (see relative_square). Rows are ranks, as printed.\n"
+        << "  inline constexpr int psq[Piece::NB_PIECE_TYPES][25] = {\n";
+    for (unsigned pt = 0; pt < Piece::NB_PIECE_TYPES; ++pt) {
+      out << "    { // " << type_names[pt] << '\n';
+      for (unsigned rank = 0; rank < 5; ++rank) {
+        out << "     ";
+        for (unsigned file = 0; file < 5; ++file) {
+          out << ' ' << std::setw(4) << w(PSQ_BASE + pt * 25 + rank * 5 + file) << ',';
+        }
+        out << '\n';
+      }
+      out << "    },\n";
+    }
+    out << "  };\n"
+        << "}\n";
+    return bool(out);
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "eval.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+Texel-style tuning of the evaluation weights (weights.hpp) against game
+results, over the records written by self-play (see selfplay.hpp).
+
+The evaluation is linear in its weights, so each position reduces to a
+feature vector: for every weight, how many more times it applies to sente
+than to gote. The tuner minimizes the mean squared error between the game
+result and sigmoid(k * eval), first fitting k to the starting weights and
+then optimizing the weights with Adam.
+
+Positions are stored as structure-of-arrays: one int8 column per material
+and hand weight, which the inner loops stream through with SIMD, and the
+sparse piece-square features in CSR form. Every pass over the data is split
+across threads, each accumulating its own gradient.
+*/
+
+namespace Tune {
+  /// Weights, flattened in the order of weights.hpp.
+  constexpr unsigned HAND_BASE = Piece::NB_PIECE_TYPES;
+  constexpr unsigned PSQ_BASE  = HAND_BASE + Piece::NB_UNPROMOTED;
+  constexpr unsigned NB_WEIGHTS = PSQ_BASE + Piece::NB_PIECE_TYPES * 25;
+  /// The material and hand weights, stored densely.
+  constexpr unsigned NB_DENSE = PSQ_BASE;
+
+  struct Dataset {
+    size_t size = 0;
+    std::vector<float> target; // game result for sente: 1, 0.5 or 0
+    std::vector<int8_t> dense[NB_DENSE];
+    // position i's piece-square features are [psq_begin[i], psq_begin[i+1])
+    std::vector<uint64_t> psq_begin{0};
+    std::vector<uint16_t> psq_index; // weight index
+    std::vector<int8_t> psq_sign;    // 1 for sente's pieces, -1 for gote's
+    std::vector<unsigned> dense_used; // dense columns that aren't all zero
+  };
+
+  /// Load a self-play record file, skipping positions whose score was a
+  /// forced mate. Returns false if it can't be read.
+  bool load(const std::string& path, Dataset& data, unsigned nb_threads);
+
+  struct Options {
+    int epochs = 500;
+    double learning_rate = 1.0; // centipawns per step, roughly
+    unsigned threads = 1;
+  };
+
+  /// The current weights of weights.hpp, flattened.
+  std::vector<double> current_weights();
+
+  /// Tune weights in place. Progress goes to log. Returns the final loss.
+  double tune(const Dataset& data, std::vector<double>& weights,
+              const Options& options, std::ostream& log);
+
+  /// Write weights as a replacement for weights.hpp.
+  bool write_header(const std::string& path, const std::vector<double>& weights);
+}
@@ -0,0 +1,322 @@
+#include "usi.hpp"
+#include "annotate.hpp"
+#include "movegen.hpp"
+#include "search.hpp"
+#include "tablebase.hpp"
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Usi {
+  /// 12 MB: search's own default is too small to keep a game's worth of
+  /// positions, and then there is little to resume from.
+  static constexpr unsigned DEFAULT_HASH_BITS = 20;
+
+  /// A score as USI puts it: mates in plies, negative if we are mated.
+  static std::string usi_score(Search::value v) {
+    if (std::abs(v) >= Search::VALUE_MATE_IN_MAX_PLY) {
+      int plies = Search::VALUE_MATE - std::abs(v);
+      return "mate " + std::to_string(v > 0 ? plies : -plies);
+    }
+    return "cp " + std::to_string(v);
+  }
+
+  /// Something for the worker to do.
+  struct Job {
+    bool new_game = false;
+    unsigned hash_bits = 0; // resize the table instead of searching
+    std::string tablebase;  // or load a tablebase file
+    bool ready = false;     // or just answer readyok
+    Board::Position start;
+    std::vector<std::string> moves;
+    Search::Limits limits;
+    int64_t movetime = 0; // 0 for none
+    bool ponder = false;  // or infinite: wait for ponderhit or stop
+  };
+
+  class Worker {
+  public:
+    explicit Worker(std::ostream& out) : out(out), thread(&Worker::run, this) { }
+
+    ~Worker() {
+      stop();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+      }
+      cv.notify_all();
+      thread.join();
+    }
+
+    /// Run a job, stopping the current one first if there is one.
+    void post(const Job& job) {
+      std::unique_lock<std::mutex> lock(mutex);
+      control.stop = true;
+      pondering = false;
+      cv.notify_all();
+      cv.wait(lock, [this]() { return !pending && !busy; });
+      next = job;
+      pending = true;
+      searching = !job.new_game && !job.hash_bits && job.tablebase.empty() && !job.ready;
+      pondering = job.ponder;
+      control.stop = false;
+      cv.notify_all();
+    }
+
+    /// Answer readyok once every job posted so far has run. A search is left
+    /// alone, since isready may come in the middle of one: anything posted
+    /// before the search has already run, so it is answered at once.
+    void ready() {
+      bool now;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        now = searching;
+      }
+      if (now) {
+        std::lock_guard<std::mutex> lock(output);
+        out << "readyok" << std::endl;
+      } else {
+        Job job;
+        job.ready = true;
+        post(job);
+      }
+    }
+
+    void stop() {
+      std::lock_guard<std::mutex> lock(mutex);
+      control.stop = true;
+      pondering = false;
+      cv.notify_all();
+    }
+
+    /// The ponder move was played: start the clock.
+    void ponderhit() {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (busy && movetime) control.deadline = Search::now() + movetime;
+      pondering = false;
+      cv.notify_all();
+    }
+
+    /// Lock this around writes to out from other threads.
+    std::mutex output;
+
+  private:
+    void run() {
+      for (;;) {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [this]() { return pending || quit; });
+          if (quit) return;
+          job = next;
+          pending = false;
+          busy = true;
+          movetime = job.movetime;
+          // a ponderhit may already have come.
+          control.deadline = movetime && !pondering ? Search::now() + movetime : 0;
+        }
+
+        if (job.hash_bits) {
+          Search::set_hash_bits(job.hash_bits);
+        } else if (!job.tablebase.empty()) {
+          // on this thread, so that no search is probing while it loads.
+          if (!Tablebase::load(job.tablebase)) {
+            std::lock_guard<std::mutex> lock(output);
+            out << "info string can't load " << job.tablebase << std::endl;
+          }
+        } else if (job.new_game) {
+          Search::clear();
+        } else if (job.ready) {
+          std::lock_guard<std::mutex> lock(output);
+          out << "readyok" << std::endl;
+        } else {
+          go(job);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        busy = false;
+        cv.notify_all();
+      }
+    }
+
+    /// Set up the job's position, search it and report.
+    void go(Job& job) {
+      Board::set_position(job.start);
+      // the game so far stays on the StateInfo list so repetitions count.
+      std::vector<Board::StateInfo> states(job.moves.size() + 1);
+      states[0].key = Board::key;
+      states[0].in_check = Movegen::in_check();
+      Board::st = &states[0];
+      for (size_t i = 0; i < job.moves.size(); ++i) {
+        Board::Move m;
+        if (!Annotate::parse_move(job.moves[i], m)) {
+          std::lock_guard<std::mutex> lock(output);
+          out << "info string illegal move " << job.moves[i] << std::endl;
+          break;
+        }
+        Board::do_move(m, states[i + 1]);
+        Board::st->in_check = Movegen::in_check();
+      }
+
+      job.limits.control = &control;
+      job.limits.resume = true;
+      int64_t start = Search::now();
+      Search::Result r = Search::search(job.limits);
+      int64_t elapsed = std::max<int64_t>(Search::now() - start, 1);
+
+      {
+        // a ponder or infinite search mustn't answer before it is told to.
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return !pondering; });
+      }
+      std::lock_guard<std::mutex> lock(output);
+      out << "info depth " << r.depth << " score " << usi_score(r.score) << " nodes " << r.nodes
+          << " nps " << r.nodes * 1000 / elapsed << " time " << elapsed;
+      if (r.resumed_depth) out << " string resumed from depth " << r.resumed_depth;
+      out << std::endl;
+      if (r.best == Board::Move()) {
+        out << "bestmove resign" << std::endl;
+      } else {
+        out << "bestmove " << r.best;
+        if (r.ponder != Board::Move()) out << " ponder " << r.ponder;
+        out << std::endl;
+      }
+      Board::st = NULL;
+    }
+
+    std::ostream& out;
+    std::mutex mutex; // guards everything below
+    std::condition_variable cv;
+    Job next;
+    bool pending = false;   // next is waiting to be run
+    bool busy = false;      // a job is running
+    bool pondering = false; // no deadline yet, and no answering either
+    bool searching = false; // next or the running job is a search
+    bool quit = false;
+    int64_t movetime = 0; // of the running job, for ponderhit
+    Search::Control control;
+    std::thread thread;
+  };
+
+  /// Parse "position ...". Returns false if the position is bad.
+  static bool parse_position(std::istringstream& is, Job& job) {
+    std::string token, fen;
+    is >> token;
+    if (token == "startpos") {
+      fen = Board::startFEN;
+      is >> token;
+    } else if (token == "sfen") {
+      std::string board, player, hand;
+      is >> board >> player >> hand;
+      fen = board + " " + player + " " + hand;
+      // skip the move number, if there is one.
+      while (is >> token && token != "moves") { }
+    } else {
+      return false;
+    }
+    try {
+      Board::importFEN(fen);
+    } catch (const std::invalid_argument&) {
+      return false;
+    }
+    // a position without both kings would crash the search.
+    if (!Movegen::is_playable()) return false;
+    Board::get_position(job.start);
+    job.moves.clear();
+    if (token == "moves") {
+      while (is >> token) job.moves.push_back(token);
+    }
+    return true;
+  }
+
+  /// Parse "go ...".
+  static void parse_go(std::istringstream& is, Job& job, Board::color us) {
+    int64_t time[2] = {0, 0}, byoyomi = 0;
+    std::string token;
+    while (is >> token) {
+      if (token == "ponder" || token == "infinite") job.ponder = true;
+      else if (token == "depth") is >> job.limits.depth;
+      else if (token == "nodes") is >> job.limits.nodes;
+      else if (token == "movetime") is >> job.movetime;
+      else if (token == "byoyomi") is >> byoyomi;
+      else if (token == "btime") is >> time[Board::SENTE];
+      else if (token == "wtime") is >> time[Board::GOTE];
+    }
+    // a simple allowance: a slice of what's left, plus the byoyomi.
+    if (!job.movetime && (time[us] || byoyomi)) job.movetime = time[us] / 30 + byoyomi * 9 / 10;
+    job.movetime = job.movetime ? std::max<int64_t>(job.movetime, 1) : 0;
+  }
+
+  void loop(std::istream& in, std::ostream& out) {
+    Worker worker(out);
+    Job hash;
+    hash.hash_bits = DEFAULT_HASH_BITS;
+    worker.post(hash);
+    Job position;
+    Board::importFEN(Board::startFEN);
+    Board::get_position(position.start);
+
+    auto say = [&](const std::string& s) {
+      std::lock_guard<std::mutex> lock(worker.output);
+      out << s << std::endl;
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+      std::istringstream is(line);
+      std::string command;
+      is >> command;
+      if (command == "quit") {
+        break;
+      } else if (command == "usi") {
+        say("id name minishogi\nid author minishogi authors\n"
+            "option name USI_Hash type spin default 12 min 1 max 1024\n"
+            "option name Tablebase type filename default <empty>\nusiok");
+      } else if (command == "setoption") {
+        std::string token, name, value;
+        is >> token >> name >> token >> value;
+        if (name == "USI_Hash") {
+          uint64_t megabytes = 0;
+          if (!(std::istringstream(value) >> megabytes) || megabytes < 1 || megabytes > 1024) {
+            say("info string USI_Hash must be 1 to 1024");
+            continue;
+          }
+          // the largest power of two number of entries that fits.
+          Job job;
+          uint64_t entries = megabytes * (1 << 20) / 12;
+          while (entries >> (job.hash_bits + 1)) ++job.hash_bits;
+          worker.post(job);
+        } else if (name == "Tablebase" && !value.empty() && value != "<empty>") {
+          Job job;
+          job.tablebase = value;
+          worker.post(job);
+        }
+      } else if (command == "isready") {
+        worker.ready();
+      } else if (command == "usinewgame") {
+        Job job;
+        job.new_game = true;
+        worker.post(job);
+      } else if (command == "position") {
+        if (!parse_position(is, position)) say("info string bad position");
+      } else if (command == "go") {
+        Job job = position;
+        // the side to move after the moves: the worker checks them properly.
+        Board::set_position(job.start);
+        Board::color us = Board::color((Board::to_move + job.moves.size()) % 2);
+        parse_go(is, job, us);
+        worker.post(job);
+      } else if (command == "stop") {
+        worker.stop();
+      } else if (command == "ponderhit") {
+        worker.ponderhit();
+      } else if (!command.empty()) {
+        say("info string unknown command " + command);
+      }
+    }
+  }
+}
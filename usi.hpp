@@ -0,0 +1,35 @@
+#pragma once
+
+#include <iostream>
+
+/*
+A USI-style protocol loop for playing games against other programs.
+
+Searches run on one long-lived worker thread, so that its thread_local
+search state (see search.hpp) lasts the whole game: the transposition table,
+history and killers are only cleared by usinewgame. Each search resumes
+iterative deepening from what the table already knows about the root (see
+Search::Limits::resume), which after a ponder hit or a predicted reply is
+usually several plies.
+
+Supported commands:
+
+  usi, isready, usinewgame, quit
+  setoption name (USI_Hash | Tablebase) value <MB | table file>
+  position (startpos | sfen <board> <player> <hand> [n]) [moves <move>...]
+  go [ponder] [infinite] [depth d] [nodes n] [movetime ms] [byoyomi ms]
+     [btime ms] [wtime ms]
+  ponderhit, stop
+
+With go ponder the search has no deadline until ponderhit, which gives it
+the time of the go command from then on; after stop it just reports its
+best move. Either way, a ponder or infinite search that finishes early
+waits for one of them before sending bestmove, as the protocol requires.
+isready is answered once the jobs setoption and usinewgame posted have run,
+so a table that fails to load is reported before readyok.
+*/
+
+namespace Usi {
+  /// Read commands from in until quit or end of input, answering on out.
+  void loop(std::istream& in, std::ostream& out);
+}
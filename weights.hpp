@@ -0,0 +1,123 @@
+#pragma once
+
+#include "piece.hpp"
+
+/*
+Evaluation weights, in centipawns. Generated by `./main tune`; edit by hand
+only to seed a tuning run.
+*/
+
+namespace Eval {
+  /// Value of each piece type on the board.
+  inline constexpr int piece_value[Piece::NB_PIECE_TYPES] = {
+    0, 100, 400, 450, 550, 650, 0, 0, 0, 450, 450, 0, 750, 900,
+  };
+
+  /// Value of each piece type in hand.
+  inline constexpr int hand_value[Piece::NB_UNPROMOTED] = {
+    0, 110, 450, 500, 600, 700,
+  };
+
+  /// Bonus for each piece type on each square, from sente's side of the
+  /// board (see relative_square). Rows are ranks, as printed.
+  inline constexpr int psq[Piece::NB_PIECE_TYPES][25] = {
+    { // -
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // pawn
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // silver
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // gold
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // bishop
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // rook
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // king
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // -
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // -
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // tokin
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // promoted silver
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // -
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // horse
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+    { // dragon
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+         0,    0,    0,    0,    0,
+    },
+  };
+}